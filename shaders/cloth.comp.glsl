@@ -0,0 +1,150 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Mass-spring cloth solver, mirrors SpringSystem::update on the processor.
+// Stage 0: collisions and spring forces, stage 1: integration, stage 2: normals.
+
+layout(local_size_x = 64) in;
+
+// MeshVertex, a vec3 would be aligned to 16 bytes so the position is three floats. Colors and texture coordinates are
+// in the other vertex stream.
+struct Vertex {
+	float x, y, z;
+	uint normal; // octahedral, two snorm16
+};
+
+struct MassPoint {
+	vec3 force;
+	vec3 velocity;
+	uint fixed;
+};
+
+struct Spring {
+	uint first;
+	uint second;
+	float k;
+	float length;
+};
+
+layout(std430, set = 0, binding = 0) buffer Vertices {
+	Vertex vertices[];
+};
+
+layout(std430, set = 0, binding = 1) buffer Points {
+	MassPoint points[];
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer Springs {
+	Spring springs[];
+};
+
+// First noPoints + 1 values are offsets into this same array, followed by (spring << 1 | isSecond) entries
+layout(std430, set = 0, binding = 3) readonly buffer PointSprings {
+	uint pointSprings[];
+};
+
+// Grid neighbours: (i-1, j), (i+1, j), (i, j-1), (i, j+1), clamped to the point itself on the edges
+layout(std430, set = 0, binding = 4) readonly buffer Neighbours {
+	uvec4 neighbours[];
+};
+
+// xyz position, w radius
+layout(std430, set = 0, binding = 5) readonly buffer Colliders {
+	vec4 colliders[];
+};
+
+layout(push_constant) uniform Parameters {
+	vec4 position;
+	vec4 scale;
+	uint stage;
+	uint noPoints;
+	uint colliderOffset;
+	uint colliderCount;
+	float time;
+	float damping;
+} params;
+
+vec3 position(uint i) {
+	return vec3(vertices[i].x, vertices[i].y, vertices[i].z);
+}
+
+// Same as MeshVertex::encodeNormal
+vec2 octEncode(vec3 n) {
+	vec2 p = n.xy / max(abs(n.x) + abs(n.y) + abs(n.z), 1e-20);
+
+	if(n.z < 0){
+		p = (1.0 - abs(p.yx)) * vec2(p.x >= 0 ? 1.0 : -1.0, p.y >= 0 ? 1.0 : -1.0);
+	}
+
+	return p;
+}
+
+void forces(uint i) {
+	vec3 pos = position(i) * params.scale.xyz + params.position.xyz;
+
+	for(uint c = 0; c < params.colliderCount; c++){
+		vec4 collider = colliders[params.colliderOffset + c];
+		vec3 diff = pos - collider.xyz;
+		float len = length(diff);
+
+		if(len < collider.w){
+			points[i].velocity += diff * (collider.w - len) / collider.w * 500.0;
+		}
+	}
+
+	vec3 force = vec3(0);
+
+	for(uint s = pointSprings[i]; s < pointSprings[i + 1]; s++){
+		uint entry = pointSprings[s];
+		Spring spring = springs[entry >> 1];
+
+		vec3 direction = position(spring.first) * params.scale.xyz - position(spring.second) * params.scale.xyz;
+		float f = -spring.k * (length(direction) - spring.length) / 2.0;
+
+		force += normalize(direction) * ((entry & 1u) == 0u ? f : -f);
+	}
+
+	points[i].force = force;
+}
+
+void integrate(uint i) {
+	if(points[i].fixed != 0u) return;
+
+	vec3 force = points[i].force;
+
+	// damping
+	force += points[i].velocity * -params.damping;
+
+	// gravity
+	force += vec3(0, 0, -9.81);
+
+	vec3 velocity = points[i].velocity + force * params.time;
+	points[i].velocity = velocity;
+
+	vec3 pos = position(i) + velocity * params.time;
+	vertices[i].x = pos.x;
+	vertices[i].y = pos.y;
+	vertices[i].z = pos.z;
+}
+
+void normal(uint i) {
+	uvec4 n = neighbours[i];
+
+	vec3 di = position(n.y) - position(n.x);
+	vec3 dj = position(n.w) - position(n.z);
+
+	vertices[i].normal = packSnorm2x16(octEncode(normalize(cross(dj, di))));
+}
+
+void main() {
+	uint i = gl_GlobalInvocationID.x;
+	if(i >= params.noPoints) return;
+
+	if(params.stage == 0){
+		forces(i);
+	}else if(params.stage == 1){
+		integrate(i);
+	}else{
+		normal(i);
+	}
+}
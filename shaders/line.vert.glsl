@@ -3,7 +3,6 @@
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
-layout(location = 2) in vec3 normal;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec3 position;
@@ -14,13 +13,18 @@ layout(set = 0, binding = 0) uniform UniformBufferObject {
     mat4 proj;
 } ubo;
 
-layout( push_constant ) uniform UniformTransformObject {
+struct MeshTransforms {
     mat4 transform;
     mat4 nTransform;
-} uniformTransform;
+};
+
+// Indexed by the first instance of the draw, the transform slot of the object
+layout(std430, set = 2, binding = 0) readonly buffer TransformBuffer {
+    MeshTransforms transforms[];
+};
 
 void main() {
-	vec4 pos = uniformTransform.transform * vec4(inPosition, 1);
+	vec4 pos = transforms[gl_InstanceIndex].transform * vec4(inPosition, 1);
 
     gl_Position = ubo.proj * ubo.view  * pos;
     gl_Position[2] /= 5.0;
@@ -3,8 +3,9 @@
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
-layout(location = 2) in vec3 normal;
+layout(location = 2) in vec2 inNormal; // octahedral
 layout(location = 3) in vec2 inTexCoord;
+layout(location = 4) in uint inTransform; // per instance
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec3 position;
@@ -16,13 +17,29 @@ layout(set = 0, binding = 0) uniform UniformBufferObject {
     mat4 proj;
 } ubo;
 
-layout( push_constant ) uniform UniformTransformObject {
-	mat4 transform;
-	mat4 nTransform;
-} uniformTransform;
+struct MeshTransforms {
+    mat4 transform;
+    mat4 nTransform;
+};
+
+// Indexed by the transform slot of the instance
+layout(std430, set = 2, binding = 0) readonly buffer TransformBuffer {
+    MeshTransforms transforms[];
+};
+
+// Inverse of MeshVertex::encodeNormal
+vec3 octDecode(vec2 e) {
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0 ? -t : t, n.y >= 0 ? -t : t);
+
+	return normalize(n);
+}
 
 void main() {
-	vec4 pos = uniformTransform.transform * vec4(inPosition, 1);
+	vec3 normal = octDecode(inNormal);
+
+	vec4 pos = transforms[inTransform].transform * vec4(inPosition, 1);
 
     gl_Position = ubo.proj * ubo.view  * pos;
     gl_Position[2] /= 5.0;
@@ -30,7 +47,7 @@ void main() {
     fragColor = vec3(inColor);
     position = vec3(pos) / pos[3];
 
-    vec4 fragNormalH = uniformTransform.nTransform * vec4(normal, 1);
+    vec4 fragNormalH = transforms[inTransform].nTransform * vec4(normal, 1);
     fragNormal = normalize(vec3(fragNormalH) / fragNormalH[3]);
 
     texCoord = inTexCoord;
@@ -1,11 +1,22 @@
 #include "Game.h"
 #include "storage/Storage.h"
+#include "data.h"
+#include "storage/SceneFile.h"
+#include "storage/Checkpoint.h"
+#include "storage/SimulationCache.h"
+#include "springsystem/ClothLOD.h"
+#include "springsystem/ClothRefinement.h"
 #include <optional>
+#include <fstream>
 
 Player *staticPlayer;
 Game *staticGame;
 double oldX = -1, oldY = -1;
 bool drawMesh = false;
+int pendingScene = 0;
+int pendingCheckpoint = 0;
+bool pendingRedraw = false;
+bool pendingDefragment = false;
 
 void staticKeyCallback(GLFWwindow *window, int key, int scancode, int action, int mods){
 	bool on;
@@ -45,9 +56,25 @@ void staticKeyCallback(GLFWwindow *window, int key, int scancode, int action, in
 			break;
 		case GLFW_KEY_F:
 			if(on) Storage::worldObjects[1]->renderComponent->pipeline = 2 * !Storage::worldObjects[1]->renderComponent->pipeline;
+			pendingRedraw |= on;
 			break;
 		case GLFW_KEY_G:
 			if(on) drawMesh = !drawMesh;
+			pendingRedraw |= on;
+			break;
+		case GLFW_KEY_1:
+		case GLFW_KEY_2:
+		case GLFW_KEY_3:
+			if(on) pendingScene = key - GLFW_KEY_0;
+			break;
+		case GLFW_KEY_K:
+			if(on) pendingCheckpoint = 1;
+			break;
+		case GLFW_KEY_L:
+			if(on) pendingCheckpoint = 2;
+			break;
+		case GLFW_KEY_M:
+			pendingDefragment |= on;
 			break;
 	}
 
@@ -80,6 +107,10 @@ void Game::init(int scene){
 	world = new World();
 	loadScene(scene);
 
+	if(restoreCheckpoint){
+		loadCheckpoint();
+	}
+
 	player = new Player(graphics->getCamera());
 	staticPlayer = player;
 
@@ -96,12 +127,288 @@ void Game::run(){
 
 		glfwPollEvents();
 
+		// Scenes are switched between frames, never from inside the key callback
+		if(pendingScene != 0){
+			loadScene(pendingScene);
+			pendingScene = 0;
+
+			// Don't simulate the time spent loading
+			time = Clock::time_point();
+		}
+
+		if(pendingCheckpoint != 0){
+			try{
+				if(pendingCheckpoint == 1) saveCheckpoint();
+				else loadCheckpoint();
+			}catch(const std::exception &e){
+				std::cerr << e.what() << std::endl;
+			}
+
+			pendingCheckpoint = 0;
+			time = Clock::time_point();
+		}
+
+		if(pendingDefragment){
+			graphics->defragment();
+			pendingDefragment = false;
+			time = Clock::time_point();
+		}
+
+		// Pipeline or spring drawing changed, the recorded draws are stale
+		if(pendingRedraw){
+			graphics->invalidateCommands();
+			pendingRedraw = false;
+		}
+
 		updateLogic();
 
 		graphics->drawFrame();
 	}
 
+	shutdown();
+}
+
+/**
+ * Runs the given number of physics steps with both solvers from the same initial state and compares the resulting
+ * cloth positions. Returns the exit code of the program.
+ */
+int Game::verifyCompute(int steps){
+	for(SpringSystem* system : Storage::sSystems){
+		system->gpu = false;
+	}
+
+	physics->update((steps + 0.5) * TIME_DELTA);
+
+	for(SpringSystem* system : Storage::sSystems){
+		system->gpu = true;
+	}
+
+	graphics->simulateSystems();
+	graphics->wait();
+
+	float maxError = 0;
+
+	for(SpringSystem* system : Storage::sSystems){
+		RenderComponent* rObj = system->object->renderComponent;
+		std::vector<Vertex> vertices = graphics->download(rObj);
+
+		for(int i = 0; i < vertices.size(); i++){
+			maxError = std::max(maxError, glm::length(vertices[i].pos - rObj->mesh.vertices[i].pos));
+		}
+	}
+
+	printf("Compute verification: %d steps, %d systems, max error %g\n", steps, (int) Storage::sSystems.size(), maxError);
+
+	shutdown();
+
+	return maxError < 1e-3 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Times the physics steps of a scene without opening a window, the cloth stays on the processor. With a golden file the
+ * state hash is taken every GOLDEN_INTERVAL steps and compared to the file, or written to it if it doesn't exist yet.
+ */
+int Game::benchmark(int scene, int steps, const std::string &golden){
+	physics = new PhysicsEngine();
+
+	Storage::init(nullptr);
+	world = new World();
+	world->load(scene);
+
+	if(restoreCheckpoint){
+		Checkpoint::restore(checkpointFile, *physics);
+	}
+
+	int points = 0;
+	for(SpringSystem* system : Storage::sSystems){
+		points += system->getNoPoints();
+	}
+
+	std::vector<std::pair<int, uint64_t>> hashes;
+	double elapsed = 0;
+
+	for(int done = 0; done < steps;){
+		int chunk = golden.empty() ? steps : std::min(GOLDEN_INTERVAL, steps - done);
+
+		auto start = Clock::now();
+		physics->step(chunk);
+		elapsed += std::chrono::duration<double, std::chrono::seconds::period>(Clock::now() - start).count();
+
+		done += chunk;
+		hashes.emplace_back(done, PhysicsEngine::stateHash());
+	}
+
+	unsigned threads = PhysicsEngine::threadPool != nullptr ? PhysicsEngine::threadPool->size() : 1;
+
+	printf("Benchmark: scene %d, %d points, %s order, %u threads, %d steps in %.3fs, %.1f steps/s, state %016llx\n",
+		   scene, points, pointOrderName(pointOrder), threads, steps, elapsed, steps / elapsed,
+		   (unsigned long long) hashes.back().second);
+
+	int result = EXIT_SUCCESS;
+
+	if(!golden.empty()){
+		std::ifstream in(golden);
+
+		if(!in.is_open()){
+			std::ofstream out(golden);
+			for(const auto& hash : hashes){
+				out << hash.first << " " << std::hex << hash.second << std::dec << "\n";
+			}
+
+			printf("Golden trajectory written to %s\n", golden.c_str());
+		}else{
+			int step;
+			uint64_t hash;
+			size_t matched = 0;
+
+			while(matched < hashes.size() && in >> step >> std::hex >> hash >> std::dec){
+				if(step != hashes[matched].first || hash != hashes[matched].second) break;
+				matched++;
+			}
+
+			if(matched == hashes.size()){
+				printf("Golden trajectory %s matches\n", golden.c_str());
+			}else{
+				printf("Golden trajectory %s differs after step %d\n", golden.c_str(), matched > 0 ? hashes[matched - 1].first : 0);
+				result = EXIT_FAILURE;
+			}
+		}
+	}
+
+	world->cleanup();
+
+	return result;
+}
+
+/**
+ * Builds a procedural scene without opening a window and writes it to a scene file.
+ */
+int Game::exportScene(int scene, const std::string &filename){
+	physics = new PhysicsEngine();
+
+	Storage::init(nullptr);
+	world = new World();
+	world->load(scene);
+
+	auto start = Clock::now();
+	SceneFile::write(filename);
+
+	printf("Exported scene %d to %s in %.2f ms\n", scene, filename.c_str(),
+		   std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+
+	world->cleanup();
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Simulates a scene without opening a window and saves the state at the end, so a cloth only has to settle once.
+ */
+int Game::settle(int scene, double seconds){
+	physics = new PhysicsEngine();
+
+	Storage::init(nullptr);
+	world = new World();
+	world->load(scene);
+
+	if(restoreCheckpoint){
+		Checkpoint::restore(checkpointFile, *physics);
+	}
+
+	auto start = Clock::now();
+	physics->update(seconds);
+	world->update(seconds);
+
+	Checkpoint::write(checkpointFile, *physics);
+
+	printf("Settled scene %d for %.2fs of simulation in %.2fs, saved to %s\n", scene, seconds,
+		   std::chrono::duration<double>(Clock::now() - start).count(), checkpointFile.c_str());
+
+	world->cleanup();
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Simulates a scene without opening a window and streams the cloth into a simulation cache at the given frame rate.
+ */
+int Game::record(int scene, const std::string &filename, int frames, float fps, bool normals){
+	physics = new PhysicsEngine();
+
+	Storage::init(nullptr);
+	world = new World();
+	world->load(scene);
+
+	if(restoreCheckpoint){
+		Checkpoint::restore(checkpointFile, *physics);
+	}
+
+	SimulationCacheWriter writer(filename, 1.0f / fps, normals);
+
+	double captureTime = 0;
+	auto start = Clock::now();
+
+	for(int i = 0; i < frames; i++){
+		if(i > 0){
+			physics->update(1.0 / fps);
+			world->update(1.0 / fps);
+		}
+
+		auto captureStart = Clock::now();
+		writer.capture();
+		captureTime += std::chrono::duration<double, std::milli>(Clock::now() - captureStart).count();
+	}
+
+	double simulated = std::chrono::duration<double>(Clock::now() - start).count();
+	writer.finish();
+
+	printf("Recorded scene %d, %d frames at %g fps in %.2fs (%.2f ms capturing, %.2fs finishing), %.1f KiB to %s\n",
+		   scene, writer.getFrameCount(), fps, simulated, captureTime,
+		   std::chrono::duration<double>(Clock::now() - start).count() - simulated,
+		   writer.getFileSize() / 1024.0, filename.c_str());
+
+	world->cleanup();
+
+	return EXIT_SUCCESS;
+}
+
+void Game::saveCheckpoint(){
+	auto start = Clock::now();
+
+	for(SpringSystem* system : Storage::sSystems){
+		if(system->gpu) graphics->syncSystem(system);
+	}
+
+	Checkpoint::write(checkpointFile, *physics);
+
+	printf("Checkpoint saved to %s in %.2f ms\n", checkpointFile.c_str(),
+		   std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+}
+
+void Game::loadCheckpoint(){
+	auto start = Clock::now();
+
+	// Steps that weren't simulated yet belong to the state being replaced
+	PhysicsEngine::pendingSteps = 0;
+	PhysicsEngine::pendingColliders.clear();
+
+	Checkpoint::restore(checkpointFile, *physics);
+	world->update(0);
+
+	for(SpringSystem* system : Storage::sSystems){
+		graphics->reloadSystem(system);
+	}
+
+	printf("Checkpoint restored from %s in %.2f ms\n", checkpointFile.c_str(),
+		   std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+}
+
+void Game::shutdown(){
 	graphics->wait();
+
+	delete playback;
+	playback = nullptr;
+
 	world->cleanup();
 	graphics->cleanup();
 }
@@ -123,20 +430,76 @@ void Game::updateLogic(){
 	t += elapsed;
 	if(((int) t) != t2){
 		t2 = (int) t;
-		printf("Time: %ds\n", t2);
+
+		if(clothSleep && !Storage::sSystems.empty()){
+			float sleeping = 0;
+			for(SpringSystem* system : Storage::sSystems){
+				sleeping += system->getSleepingFraction();
+			}
+
+			printf("Time: %ds, %.0f%% of the cloth asleep\n", t2, 100 * sleeping / Storage::sSystems.size());
+		}else{
+			printf("Time: %ds\n", t2);
+		}
+
+		if(memoryStats) graphics->printMemoryStats();
+	}
+
+	if(deterministic){
+		physics->step(FRAME_STEPS);
+		world->update(FRAME_STEPS * TIME_DELTA);
+	}else{
+		physics->update(elapsed);
+		world->update(elapsed);
 	}
 
-	physics->update(elapsed);
-	world->update(elapsed);
 	player->update(elapsed);
+
+	world->frameUpdate(graphics->getFrameView());
 }
 
 void Game::loadScene(int i){
+	auto start = Clock::now();
+
 	graphics->wait();
+
+	delete playback;
+	playback = nullptr;
+
 	world->cleanup();
 	graphics->clear();
 
+	auto loadStart = Clock::now();
+
 	world->load(i);
 
+	if(clothLod && playbackFile.empty()){
+		for(SpringSystem* system : Storage::sSystems){
+			if(!system->gpu) Storage::create<ClothLOD>(system);
+		}
+	}
+
+	if(clothRefine > 0 && playbackFile.empty()){
+		for(SpringSystem* system : Storage::sSystems){
+			if(!system->gpu) Storage::create<ClothRefinement>(system, clothRefine);
+		}
+	}
+
+	if(!playbackFile.empty()){
+		try{
+			playback = new CachePlayback(playbackFile);
+		}catch(const std::exception &e){
+			std::cerr << e.what() << ", simulating scene " << i << " instead" << std::endl;
+		}
+	}
+
 	graphics->initData();
+
+	auto end = Clock::now();
+
+	if(sceneStats){
+		printf("Scene %d: teardown %.2f ms, load %.2f ms\n", i,
+			   std::chrono::duration<double, std::milli>(loadStart - start).count(),
+			   std::chrono::duration<double, std::milli>(end - loadStart).count());
+	}
 }
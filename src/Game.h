@@ -7,9 +7,16 @@
 #include "player/Player.h"
 #include "graphics/Graphics.h"
 #include "physics/PhysicsEngine.h"
+#include "springsystem/CachePlayback.h"
 
 #define TICK 100
 
+// Physics steps per frame in deterministic mode, independent of the frame time
+#define FRAME_STEPS 16
+
+// Steps between the state hashes of a golden trajectory
+#define GOLDEN_INTERVAL 100
+
 typedef std::chrono::high_resolution_clock Clock;
 
 extern bool drawMesh;
@@ -18,9 +25,17 @@ class Game {
 public:
 	void init(int scene);
 	void run();
+	int verifyCompute(int steps);
+	int benchmark(int scene, int steps, const std::string &golden);
+	int exportScene(int scene, const std::string &filename);
+	int settle(int scene, double seconds);
+	int record(int scene, const std::string &filename, int frames, float fps, bool normals);
+	void saveCheckpoint();
+	void loadCheckpoint();
 	void loadScene(int i);
 private:
 	void updateLogic();
+	void shutdown();
 
 	Clock::time_point time;
 
@@ -28,6 +43,7 @@ private:
 	Player* player;
 	Graphics* graphics;
 	PhysicsEngine* physics;
+	CachePlayback* playback = nullptr;
 };
 
 
@@ -0,0 +1,212 @@
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include "Sweep.h"
+#include "Game.h"
+#include "data.h"
+#include "storage/Storage.h"
+
+static const std::pair<const char*, float SimulationParameters::*> parameterNames[] = {
+		{ "k1", &SimulationParameters::k1 },
+		{ "k2", &SimulationParameters::k2 },
+		{ "k3", &SimulationParameters::k3 },
+		{ "mass", &SimulationParameters::mass },
+		{ "damping", &SimulationParameters::damping }
+};
+
+Sweep::Sweep(int scene, int points, int steps) : scene(scene), points(points), steps(steps){
+
+}
+
+/**
+ * Grid of the form "k1=250000,500000;k3=100,500", every combination of the listed values is run. Parameters that aren't
+ * listed keep their defaults. Scene files (scene 0) store the spring constants, so k1, k2 and k3 can't be swept there.
+ */
+void Sweep::parseGrid(const std::string &grid){
+	std::stringstream parameters(grid);
+	std::string parameter;
+
+	while(std::getline(parameters, parameter, ';')){
+		if(parameter.empty()) continue;
+
+		size_t equals = parameter.find('=');
+		std::string name = parameter.substr(0, equals);
+
+		float SimulationParameters::* field = nullptr;
+		for(const auto& entry : parameterNames){
+			if(name == entry.first) field = entry.second;
+		}
+
+		if(field == nullptr || equals == std::string::npos){
+			throw std::runtime_error("unknown sweep parameter " + parameter);
+		}
+
+		if(scene == 0 && (field == &SimulationParameters::k1 || field == &SimulationParameters::k2 || field == &SimulationParameters::k3)){
+			throw std::runtime_error("sweep parameter " + name + " has no effect on a scene file, its springs keep the stored constants");
+		}
+
+		std::vector<float> values;
+		std::stringstream list(parameter.substr(equals + 1));
+		std::string value;
+
+		while(std::getline(list, value, ',')){
+			values.push_back(std::stof(value));
+		}
+
+		std::vector<SimulationParameters> combined;
+		for(const SimulationParameters& run : runs){
+			for(float v : values){
+				combined.push_back(run);
+				combined.back().*field = v;
+			}
+		}
+
+		runs = combined;
+	}
+}
+
+int Sweep::run(unsigned threads, const std::string &output){
+	threads = std::max(1u, std::min<unsigned>(threads, runs.size()));
+
+	printf("Sweep: scene %d, %d points, %d steps, %zu runs on %u threads\n", scene, points, steps, runs.size(), threads);
+
+	std::vector<Result> results(runs.size());
+	std::atomic<size_t> next{ 0 };
+
+	auto worker = [&]{
+		for(size_t i = next++; i < runs.size(); i = next++){
+			results[i] = simulate(runs[i]);
+
+			if(results[i].error.empty()){
+				printf("Run %zu: max stretch %g, energy %g, %.1f steps/s\n", i, results[i].maxStretch, results[i].energy, results[i].stepsPerSecond);
+			}else{
+				printf("Run %zu failed: %s\n", i, results[i].error.c_str());
+			}
+		}
+	};
+
+	auto start = Clock::now();
+
+	std::vector<std::thread> workers;
+	for(unsigned i = 0; i < threads; i++){
+		workers.emplace_back(worker);
+	}
+
+	for(std::thread& thread : workers){
+		thread.join();
+	}
+
+	if(output.size() >= 5 && output.compare(output.size() - 5, 5, ".json") == 0){
+		writeJson(output, results);
+	}else{
+		writeCsv(output, results);
+	}
+
+	printf("Sweep finished in %.2fs, results written to %s\n",
+		   std::chrono::duration<double>(Clock::now() - start).count(), output.c_str());
+
+	for(const Result& result : results){
+		if(!result.error.empty()) return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Runs on a worker thread, the scene lives in that thread's Storage and PhysicsEngine state.
+ */
+Sweep::Result Sweep::simulate(const SimulationParameters &parameters) const{
+	Result result;
+	result.parameters = parameters;
+
+	noPoints = points;
+	simulationParameters = parameters;
+
+	PhysicsEngine physics;
+	Storage::init(nullptr);
+	World world;
+
+	try{
+		world.load(scene);
+
+		double elapsed = 0;
+
+		for(int done = 0; done < steps; done += SWEEP_SAMPLE){
+			auto start = Clock::now();
+			physics.step(std::min(SWEEP_SAMPLE, steps - done));
+			elapsed += std::chrono::duration<double>(Clock::now() - start).count();
+
+			for(SpringSystem* system : Storage::sSystems){
+				result.maxStretch = std::max(result.maxStretch, system->getMaxStretch());
+			}
+		}
+
+		for(SpringSystem* system : Storage::sSystems){
+			result.energy += system->getEnergy();
+		}
+
+		result.stepsPerSecond = steps / elapsed;
+		result.state = PhysicsEngine::stateHash();
+	}catch(const std::exception &e){
+		result.error = e.what();
+	}
+
+	world.cleanup();
+
+	return result;
+}
+
+void Sweep::writeCsv(const std::string &filename, const std::vector<Result> &results) const{
+	std::ofstream out(filename);
+	if(!out.is_open()){
+		throw std::runtime_error("failed to open file " + filename);
+	}
+
+	out << "run,k1,k2,k3,mass,damping,max_stretch,energy,steps_per_second,state,error\n";
+
+	for(size_t i = 0; i < results.size(); i++){
+		const Result& r = results[i];
+
+		out << i << "," << r.parameters.k1 << "," << r.parameters.k2 << "," << r.parameters.k3 << "," << r.parameters.mass
+			<< "," << r.parameters.damping << "," << r.maxStretch << "," << r.energy << "," << r.stepsPerSecond << ","
+			<< std::hex << r.state << std::dec << ",\"" << r.error << "\"\n";
+	}
+}
+
+void Sweep::writeJson(const std::string &filename, const std::vector<Result> &results) const{
+	std::ofstream out(filename);
+	if(!out.is_open()){
+		throw std::runtime_error("failed to open file " + filename);
+	}
+
+	// A cloth that blew up has no valid JSON number
+	auto number = [](double value){
+		std::ostringstream text;
+		if(std::isfinite(value)) text << value;
+		else text << "null";
+		return text.str();
+	};
+
+	out << "[\n";
+
+	for(size_t i = 0; i < results.size(); i++){
+		const Result& r = results[i];
+
+		out << "\t{ \"run\": " << i << ", \"k1\": " << r.parameters.k1 << ", \"k2\": " << r.parameters.k2
+			<< ", \"k3\": " << r.parameters.k3 << ", \"mass\": " << r.parameters.mass << ", \"damping\": " << r.parameters.damping;
+
+		if(r.error.empty()){
+			out << ", \"max_stretch\": " << number(r.maxStretch) << ", \"energy\": " << number(r.energy)
+				<< ", \"steps_per_second\": " << number(r.stepsPerSecond) << ", \"state\": \"" << std::hex << r.state << std::dec << "\" }";
+		}else{
+			out << ", \"error\": \"" << r.error << "\" }";
+		}
+
+		out << (i + 1 < results.size() ? ",\n" : "\n");
+	}
+
+	out << "]\n";
+}
@@ -0,0 +1,47 @@
+#ifndef VULK_SWEEP_H
+#define VULK_SWEEP_H
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "springsystem/SimulationParameters.h"
+
+// Steps between two samples of the spring stretch
+#define SWEEP_SAMPLE 10
+
+/**
+ * Simulates a scene without opening a window for every combination of a parameter grid. Runs are spread over worker
+ * threads, each one builds its scenes in its own thread local storage.
+ */
+class Sweep {
+public:
+	Sweep(int scene, int points, int steps);
+
+	void parseGrid(const std::string &grid);
+	int run(unsigned threads, const std::string &output);
+
+private:
+	struct Result {
+		SimulationParameters parameters;
+		float maxStretch = 0;
+		double energy = 0;
+		double stepsPerSecond = 0;
+		uint64_t state = 0;
+		std::string error;
+	};
+
+	int scene;
+	int points;
+	int steps;
+
+	std::vector<SimulationParameters> runs = { SimulationParameters() };
+
+	Result simulate(const SimulationParameters &parameters) const;
+
+	void writeCsv(const std::string &filename, const std::vector<Result> &results) const;
+	void writeJson(const std::string &filename, const std::vector<Result> &results) const;
+};
+
+
+#endif //VULK_SWEEP_H
@@ -4,10 +4,33 @@ void CosLine::update(double time){
 	float delta = cos(2.0f * M_PI * (totalTime + time) / period) - cos(2.0f * M_PI * totalTime / period);
 	totalTime += time;
 
-	object->position += influences * amplitude * delta;
+	object->move(influences * amplitude * delta);
 }
 
 CosLine::CosLine(WorldObject *obj, const glm::vec3& influences, float amplitude, float period) : IObjectModifier(obj),
 																								 influences(influences),
 																								 amplitude(amplitude),
 																								 period(period){}
+
+const glm::vec3& CosLine::getInfluences() const{
+	return influences;
+}
+
+float CosLine::getAmplitude() const{
+	return amplitude;
+}
+
+float CosLine::getPeriod() const{
+	return period;
+}
+
+float CosLine::getTotalTime() const{
+	return totalTime;
+}
+
+/**
+ * Only restores the phase of the movement, the object is expected to be moved to the matching position separately.
+ */
+void CosLine::setTotalTime(float totalTime){
+	CosLine::totalTime = totalTime;
+}
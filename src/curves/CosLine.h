@@ -10,6 +10,13 @@ public:
 
 	virtual void update(double time);
 
+	const glm::vec3& getInfluences() const;
+	float getAmplitude() const;
+	float getPeriod() const;
+
+	float getTotalTime() const;
+	void setTotalTime(float totalTime);
+
 private:
 	glm::vec3 influences;
 	float amplitude;
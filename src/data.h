@@ -1,6 +1,27 @@
 #ifndef VULK_DATA_H
 #define VULK_DATA_H
 
-extern int noPoints;
+#include <string>
+#include "springsystem/PointOrder.h"
+#include "springsystem/SimulationParameters.h"
+
+// Per thread, so parameter sweeps can build several scenes at once
+extern thread_local int noPoints;
+extern thread_local SimulationParameters simulationParameters;
+
+extern bool gpuCloth;
+extern PointOrder pointOrder;
+extern std::string sceneFile;
+extern std::string checkpointFile;
+extern bool restoreCheckpoint;
+extern std::string playbackFile;
+extern bool deterministic;
+extern bool clothLod;
+extern bool clothSleep;
+extern unsigned clothRefine;
+extern unsigned drawThreads;
+extern bool drawBench;
+extern bool memoryStats;
+extern bool sceneStats;
 
 #endif //VULK_DATA_H
@@ -5,12 +5,25 @@
 #include <vulkan/vulkan.h>
 #include "../../VulkanMemoryAllocator/src/VmaUsage.h"
 
+class GeometryBuffer;
+
 class BufferAllocation {
 public:
 	BufferAllocation(VkBuffer buffer, VmaAllocation allocation);
 
 	VkBuffer buffer;
 	VmaAllocation allocation;
+
+	// Part of a GeometryBuffer shared with other objects, a dedicated buffer starts at 0 and spans the whole buffer
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = VK_WHOLE_SIZE;
+	GeometryBuffer* owner = nullptr;
+
+	// Of a dedicated buffer, to create it again when defragmentation moves its memory
+	VkBufferUsageFlags usage = 0;
+
+	// The same vertices in the companion buffer of the owner, freed with this allocation
+	BufferAllocation* companion = nullptr;
 };
 
 
@@ -0,0 +1,117 @@
+#include <iterator>
+#include <stdexcept>
+#include "GeometryBuffer.h"
+
+GeometryBuffer::GeometryBuffer(VmaAllocator allocator, VmaPool pool, VkDeviceSize capacity, VkBufferUsageFlags usage) :
+		allocator(allocator), capacity(capacity){
+	createBuffer(allocator, pool, capacity, usage, buffer, allocation);
+
+	freeRanges[0] = capacity;
+}
+
+GeometryBuffer::GeometryBuffer(VmaAllocator allocator, VmaPool pool, VkDeviceSize capacity, VkBufferUsageFlags usage, VkDeviceSize stride,
+							   VkDeviceSize companionStride, VkBufferUsageFlags companionUsage) : GeometryBuffer(allocator, pool, capacity, usage){
+	GeometryBuffer::stride = stride;
+	GeometryBuffer::companionStride = companionStride;
+
+	createBuffer(allocator, pool, capacity / stride * companionStride, companionUsage, companion, companionAllocation);
+}
+
+GeometryBuffer::~GeometryBuffer(){
+	vmaDestroyBuffer(allocator, buffer, allocation);
+
+	if(companion != VK_NULL_HANDLE){
+		vmaDestroyBuffer(allocator, companion, companionAllocation);
+	}
+}
+
+void GeometryBuffer::createBuffer(VmaAllocator allocator, VmaPool pool, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer &buffer,
+								  VmaAllocation &allocation){
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = usage;
+
+	VmaAllocationCreateInfo allocInfo = {};
+	allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+	allocInfo.pool = pool;
+
+	if(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &buffer, &allocation, nullptr) != VK_SUCCESS){
+		throw std::runtime_error("failed to create geometry buffer!");
+	}
+}
+
+/**
+ * First fit, the part of the range before the aligned offset stays free. Returns nullptr when nothing fits. With a
+ * companion buffer the alignment has to be a multiple of the stride.
+ */
+BufferAllocation* GeometryBuffer::allocate(VkDeviceSize size, VkDeviceSize alignment){
+	for(auto it = freeRanges.begin(); it != freeRanges.end(); ++it){
+		VkDeviceSize start = it->first;
+		VkDeviceSize end = it->first + it->second;
+		VkDeviceSize offset = (start + alignment - 1) / alignment * alignment;
+
+		if(offset + size > end) continue;
+
+		freeRanges.erase(it);
+		if(offset > start) freeRanges[start] = offset - start;
+		if(offset + size < end) freeRanges[offset + size] = end - offset - size;
+
+		used += size;
+
+		BufferAllocation* suballocation = new BufferAllocation(buffer, allocation);
+		suballocation->offset = offset;
+		suballocation->size = size;
+		suballocation->owner = this;
+
+		if(companion != VK_NULL_HANDLE){
+			suballocation->companion = new BufferAllocation(companion, companionAllocation);
+			suballocation->companion->offset = offset / stride * companionStride;
+			suballocation->companion->size = size / stride * companionStride;
+		}
+
+		return suballocation;
+	}
+
+	return nullptr;
+}
+
+void GeometryBuffer::free(BufferAllocation *suballocation){
+	VkDeviceSize offset = suballocation->offset;
+	VkDeviceSize size = suballocation->size;
+	used -= size;
+
+	auto next = freeRanges.lower_bound(offset);
+
+	if(next != freeRanges.end() && next->first == offset + size){
+		size += next->second;
+		next = freeRanges.erase(next);
+	}
+
+	if(next != freeRanges.begin()){
+		auto previous = std::prev(next);
+
+		if(previous->first + previous->second == offset){
+			offset = previous->first;
+			size += previous->second;
+			freeRanges.erase(previous);
+		}
+	}
+
+	freeRanges[offset] = size;
+
+	delete suballocation->companion;
+	delete suballocation;
+}
+
+VkBuffer GeometryBuffer::getBuffer() const{
+	return buffer;
+}
+
+VkDeviceSize GeometryBuffer::getCapacity() const{
+	return capacity;
+}
+
+VkDeviceSize GeometryBuffer::getUsed() const{
+	return used;
+}
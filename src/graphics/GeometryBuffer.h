@@ -0,0 +1,57 @@
+#ifndef VULK_GEOMETRYBUFFER_H
+#define VULK_GEOMETRYBUFFER_H
+
+
+#include <map>
+#include "BufferAllocation.h"
+
+// Size of a new geometry buffer, larger meshes get a buffer of their own size
+#define GEOMETRY_BUFFER_SIZE (64 << 20)
+
+/**
+ * One large device buffer that the vertices or indices of many render objects are suballocated from, so draws of
+ * different objects can share their buffer bindings. Free space is kept as a list of ranges, neighbouring ranges are
+ * merged when a suballocation is freed.
+ *
+ * A vertex buffer can have a companion buffer for a second vertex stream. Every stride bytes of the buffer get
+ * companionStride bytes of the companion, so a suballocation of whole strides has its companion at the same vertex
+ * index and one vertex offset serves both bindings.
+ */
+class GeometryBuffer {
+public:
+	GeometryBuffer(VmaAllocator allocator, VmaPool pool, VkDeviceSize capacity, VkBufferUsageFlags usage);
+	GeometryBuffer(VmaAllocator allocator, VmaPool pool, VkDeviceSize capacity, VkBufferUsageFlags usage, VkDeviceSize stride,
+				   VkDeviceSize companionStride, VkBufferUsageFlags companionUsage);
+	~GeometryBuffer();
+
+	GeometryBuffer(const GeometryBuffer&) = delete;
+	GeometryBuffer& operator=(const GeometryBuffer&) = delete;
+
+	BufferAllocation* allocate(VkDeviceSize size, VkDeviceSize alignment);
+	void free(BufferAllocation *allocation);
+
+	VkBuffer getBuffer() const;
+	VkDeviceSize getCapacity() const;
+	VkDeviceSize getUsed() const;
+
+private:
+	VmaAllocator allocator;
+	VkBuffer buffer;
+	VmaAllocation allocation;
+	VkDeviceSize capacity;
+	VkDeviceSize used = 0;
+
+	VkBuffer companion = VK_NULL_HANDLE;
+	VmaAllocation companionAllocation = VK_NULL_HANDLE;
+	VkDeviceSize stride = 1;
+	VkDeviceSize companionStride = 0;
+
+	static void createBuffer(VmaAllocator allocator, VmaPool pool, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer &buffer,
+							 VmaAllocation &allocation);
+
+	// Offset to size of every free range
+	std::map<VkDeviceSize, VkDeviceSize> freeRanges;
+};
+
+
+#endif //VULK_GEOMETRYBUFFER_H
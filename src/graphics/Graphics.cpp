@@ -2,21 +2,19 @@
 #include "../storage/Storage.h"
 #include "Vulkan.h"
 #include "../Game.h"
+#include "../data.h"
+#include "../springsystem/ClothRefinement.h"
 
 
 void Graphics::init(){
 	vulk.init();
 	window = vulk.window;
+	allocator = vulk.allocator;
 
 	//initData();
 }
 
 void Graphics::initData(){
-	VmaAllocatorCreateInfo allocatorInfo = {};
-	allocatorInfo.physicalDevice = vulk.physicalDevice;
-	allocatorInfo.device = vulk.device;
-	vmaCreateAllocator(&allocatorInfo, &allocator);
-
 	for(int i = 0; i < Storage::renderObjects.size(); i++){
 		regObject(Storage::renderObjects[i]);
 	}
@@ -24,50 +22,460 @@ void Graphics::initData(){
 	for(int i = 0; i < Storage::springs.size(); i++){
 		regSpring(Storage::springs[i]);
 	}
+
+	if(gpuCloth){
+		allocateColliders(1024);
+	}
+
+	for(SpringSystem* system : Storage::sSystems){
+		if(system->gpu) regSystem(system);
+	}
 }
 
+/**
+ * Uploads the object's geometry. Shared components of a mesh that is already uploaded only take the existing
+ * allocations, the instanced draw tells them apart by their transform slots.
+ */
 void Graphics::regObject(RenderComponent *rObj){
-	rObj->vertexBuffer = allocate(rObj->mesh.vertices.size() * sizeof(Vertex),
-								  VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+	if(rObj->sharedMesh != nullptr){
+		auto it = sharedGeometry.find(rObj->sharedMesh.get());
+
+		if(it != sharedGeometry.end()){
+			rObj->vertexBuffer = it->second.vertexBuffer;
+			rObj->indexBuffer = it->second.indexBuffer;
+			rObj->indexType = it->second.indexType;
+			it->second.users++;
+
+			vulk.invalidateCommandBuffers();
+			return;
+		}
+	}
+
+	const Mesh& mesh = rObj->getMesh();
+
+	// Vertices stay whole vertices apart for the draw's vertex offset and aligned for the cloth compute shader
+	VkDeviceSize storageAlignment = vulk.getStorageAlignment();
+	VkDeviceSize vertexAlignment = sizeof(MeshVertex);
+	while(vertexAlignment % storageAlignment != 0) vertexAlignment += sizeof(MeshVertex);
+
+	rObj->vertexBuffer = allocateGeometry(vertexGeometry, mesh.vertices.size() * sizeof(MeshVertex), vertexAlignment,
+										  VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+										  sizeof(MeshVertex), sizeof(MeshAttributes), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+
+	// Colors and texture coordinates never change, only the MeshVertex stream is uploaded again
+	std::vector<MeshAttributes> attributes;
+	attributes.reserve(mesh.vertices.size());
+
+	for(const Vertex& vertex : mesh.vertices){
+		attributes.emplace_back(vertex);
+	}
+
+	upload(rObj->vertexBuffer->companion, attributes.size() * sizeof(MeshAttributes), attributes.data());
+	uploadVertices(rObj, 0, mesh.vertices.size());
+
+	rObj->indexType = mesh.indexType();
+
+	if(rObj->indexType == VK_INDEX_TYPE_UINT16){
+		std::vector<uint16_t> indices = mesh.shortIndices();
+
+		rObj->indexBuffer = allocateGeometry(indexGeometry, indices.size() * sizeof(uint16_t), sizeof(uint16_t),
+											 VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+		upload(rObj->indexBuffer, indices.size() * sizeof(uint16_t), indices.data());
+	}else{
+		rObj->indexBuffer = allocateGeometry(indexGeometry, mesh.indices.size() * sizeof(uint32_t), sizeof(uint32_t),
+											 VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+		upload(rObj->indexBuffer, mesh.indices.size() * sizeof(uint32_t), mesh.indices.data());
+	}
 
-	rObj->indexBuffer = allocate(rObj->mesh.indices.size() * sizeof(uint16_t),
-								 VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+	if(rObj->sharedMesh != nullptr){
+		sharedGeometry[rObj->sharedMesh.get()] = { rObj->vertexBuffer, rObj->indexBuffer, rObj->indexType, 1 };
+	}
 
-	upload(rObj->vertexBuffer, rObj->mesh.vertices.size() * sizeof(Vertex), rObj->mesh.vertices.data());
-	upload(rObj->indexBuffer, rObj->mesh.indices.size() * sizeof(uint16_t), rObj->mesh.indices.data());
+	vulk.invalidateCommandBuffers();
 }
 
 void Graphics::deregObject(RenderComponent *rObj){
-	vmaDestroyBuffer(allocator, rObj->vertexBuffer->buffer, rObj->vertexBuffer->allocation);
-	vmaDestroyBuffer(allocator, rObj->indexBuffer->buffer, rObj->indexBuffer->allocation);
+	// Shared geometry is freed with its last user
+	auto it = rObj->sharedMesh != nullptr ? sharedGeometry.find(rObj->sharedMesh.get()) : sharedGeometry.end();
+
+	if(it == sharedGeometry.end() || --it->second.users == 0){
+		rObj->vertexBuffer->owner->free(rObj->vertexBuffer);
+		rObj->indexBuffer->owner->free(rObj->indexBuffer);
+
+		if(it != sharedGeometry.end()) sharedGeometry.erase(it);
+	}
+
+	rObj->vertexBuffer = nullptr;
+	rObj->indexBuffer = nullptr;
+}
+
+/**
+ * Suballocates from the first geometry buffer with room, or from a new one once they are all full. A non zero
+ * companionStride gives new buffers a companion, see GeometryBuffer.
+ */
+BufferAllocation* Graphics::allocateGeometry(std::vector<std::unique_ptr<GeometryBuffer>> &buffers, VkDeviceSize size,
+											 VkDeviceSize alignment, VkBufferUsageFlags usage, VkDeviceSize stride,
+											 VkDeviceSize companionStride, VkBufferUsageFlags companionUsage){
+	for(std::unique_ptr<GeometryBuffer>& buffer : buffers){
+		BufferAllocation* allocation = buffer->allocate(size, alignment);
+		if(allocation != nullptr) return allocation;
+	}
+
+	VkDeviceSize capacity = std::max<VkDeviceSize>(GEOMETRY_BUFFER_SIZE, size);
+
+	if(companionStride == 0){
+		buffers.emplace_back(new GeometryBuffer(allocator, vulk.getPool(MemoryPool::GEOMETRY), capacity, usage));
+	}else{
+		buffers.emplace_back(new GeometryBuffer(allocator, vulk.getPool(MemoryPool::GEOMETRY), capacity, usage, stride, companionStride,
+												companionUsage));
+	}
+
+	return buffers.back()->allocate(size, alignment);
 }
 
 void Graphics::regSpring(Spring *spring){
-	spring->vertexBuffer = allocate(2 * sizeof(Vertex),
-									VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+	// Whole vertices apart, so the draw can address them by its first vertex
+	spring->vertexBuffer = allocateGeometry(lineGeometry, spring->vertices.size() * sizeof(LineVertex), sizeof(LineVertex),
+											VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+
+	upload(spring->vertexBuffer, spring->vertices.size() * sizeof(LineVertex), spring->vertices.data());
 
-	upload(spring->vertexBuffer, spring->vertices.size() * sizeof(Vertex), spring->vertices.data());
+	vulk.invalidateCommandBuffers();
+}
+
+/**
+ * Draw commands are recorded once and reused, anything that changes what gets drawn has to call this.
+ */
+void Graphics::invalidateCommands(){
+	vulk.invalidateCommandBuffers();
 }
 
 void Graphics::deregSpring(Spring *spring){
-	vmaDestroyBuffer(allocator, spring->vertexBuffer->buffer, spring->vertexBuffer->allocation);
+	spring->vertexBuffer->owner->free(spring->vertexBuffer);
+	spring->vertexBuffer = nullptr;
+}
+
+/**
+ * Uploads the state of a spring system for the compute solver. Springs are also listed per point (in spring order, the
+ * same order in which the processor accumulates their forces), so every invocation of the shader only writes to its
+ * own point.
+ */
+void Graphics::regSystem(SpringSystem *system){
+	std::vector<glMassPoint> points(system->getNoPoints());
+
+	for(int i = 0; i < points.size(); i++){
+		MassPoint* point = system->getPoint(i);
+		points[i].force = { 0, 0, 0 };
+		points[i].velocity = point->getVelocity();
+		points[i].fixed = point->isFixed();
+	}
+
+	const std::vector<Spring*>& springs = system->getSprings();
+	std::vector<glSpring> glSprings(springs.size());
+
+	for(int i = 0; i < springs.size(); i++){
+		glSprings[i] = { springs[i]->getIndexes().first, springs[i]->getIndexes().second, springs[i]->k, springs[i]->length };
+	}
+
+	// Offsets of every point's list, followed by the lists themselves
+	std::vector<uint32_t> pointSprings = system->getPointSprings();
+
+	std::vector<glm::uvec4> neighbours = system->getNeighbours();
+
+	VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	VmaPool pool = vulk.getPool(MemoryPool::CLOTH);
+	system->pointBuffer = allocate(points.size() * sizeof(glMassPoint), usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_GPU_ONLY, pool);
+	system->springBuffer = allocate(std::max<size_t>(glSprings.size(), 1) * sizeof(glSpring), usage, VMA_MEMORY_USAGE_GPU_ONLY, pool);
+	system->pointSpringBuffer = allocate(pointSprings.size() * sizeof(uint32_t), usage, VMA_MEMORY_USAGE_GPU_ONLY, pool);
+	system->neighbourBuffer = allocate(neighbours.size() * sizeof(glm::uvec4), usage, VMA_MEMORY_USAGE_GPU_ONLY, pool);
+
+	upload(system->pointBuffer, points.size() * sizeof(glMassPoint), points.data());
+	if(!glSprings.empty()) upload(system->springBuffer, glSprings.size() * sizeof(glSpring), glSprings.data());
+	upload(system->pointSpringBuffer, pointSprings.size() * sizeof(uint32_t), pointSprings.data());
+	upload(system->neighbourBuffer, neighbours.size() * sizeof(glm::uvec4), neighbours.data());
+
+	system->descriptorSet = vulk.createClothDescriptorSet({
+			system->object->renderComponent->vertexBuffer,
+			system->pointBuffer,
+			system->springBuffer,
+			system->pointSpringBuffer,
+			system->neighbourBuffer,
+			colliderBuffer
+	});
+}
+
+void Graphics::deregSystem(SpringSystem *system){
+	vulk.freeClothDescriptorSet(system->descriptorSet);
+
+	release(system->pointBuffer);
+	release(system->springBuffer);
+	release(system->pointSpringBuffer);
+	release(system->neighbourBuffer);
+}
+
+void Graphics::allocateColliders(size_t capacity){
+	if(colliderBuffer != nullptr){
+		release(colliderBuffer);
+	}
+
+	colliderBuffer = allocate(capacity * sizeof(glm::vec4), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+	colliderCapacity = capacity;
+}
+
+/**
+ * Runs the physics steps that were taken since the last call on the GPU, for every spring system that is simulated
+ * there. The steps are replayed with the collider positions recorded by PhysicsEngine, so the result matches the
+ * processor solver.
+ */
+void Graphics::simulateSystems(){
+	int steps = PhysicsEngine::pendingSteps;
+	std::vector<glm::vec4> &colliders = PhysicsEngine::pendingColliders;
+
+	if(steps == 0) return;
+
+	// The solver is submitted before the frame, uploads it reads have to be submitted before it
+	vulk.flushUploads();
+	vulk.beginClothCompute();
+
+	if(colliders.size() > colliderCapacity){
+		allocateColliders(std::max(colliders.size(), 2 * colliderCapacity));
+
+		for(SpringSystem* system : Storage::sSystems){
+			if(system->gpu) vulk.updateClothDescriptorSet(system->descriptorSet, 5, colliderBuffer);
+		}
+	}
+
+	if(!colliders.empty()){
+		void* data;
+		vmaMapMemory(allocator, colliderBuffer->allocation, &data);
+		memcpy(data, colliders.data(), colliders.size() * sizeof(glm::vec4));
+		vmaUnmapMemory(allocator, colliderBuffer->allocation);
+	}
+
+	for(SpringSystem* system : Storage::sSystems){
+		if(!system->gpu) continue;
+
+		ClothPushConstants params = {};
+		params.position = glm::vec4(system->object->getPosition(), 0.0f);
+		params.scale = glm::vec4(system->object->getScale(), 0.0f);
+		params.noPoints = system->getNoPoints();
+		params.colliderCount = colliders.size() / steps;
+		params.time = TIME_DELTA;
+		params.damping = system->getParameters().damping;
+
+		vulk.dispatchCloth(system->descriptorSet, params, steps);
+	}
+
+	vulk.endClothCompute();
+
+	PhysicsEngine::pendingSteps = 0;
+	colliders.clear();
 }
 
+/**
+ * Reads the vertices of a render object back from the GPU, used to compare the compute solver against the processor.
+ */
+std::vector<Vertex> Graphics::download(RenderComponent *rObj){
+	std::vector<Vertex> vertices = rObj->mesh.vertices;
+	downloadVertices(rObj, vertices.data());
+
+	return vertices;
+}
 
-BufferAllocation *Graphics::allocate(VkDeviceSize size, VkBufferUsageFlags bufferUsage, VmaMemoryUsage memoryUsage){
+/**
+ * Packs the positions and normals of the vertices [first, last) of a render object into MeshVertex and uploads them to
+ * their place in its buffer.
+ */
+void Graphics::uploadVertices(RenderComponent *rObj, size_t first, size_t last){
+	packedVertices.clear();
+
+	for(size_t i = first; i < last; i++){
+		packedVertices.emplace_back(rObj->getMesh().vertices[i]);
+	}
+
+	upload(rObj->vertexBuffer, packedVertices.size() * sizeof(MeshVertex), packedVertices.data(), first * sizeof(MeshVertex));
+}
+
+/**
+ * Unpacks the positions and normals of a render object's buffer into vertices, the rest of them is left as it is.
+ */
+void Graphics::downloadVertices(RenderComponent *rObj, Vertex *vertices){
+	packedVertices.resize(rObj->mesh.vertices.size());
+	download(rObj->vertexBuffer, packedVertices.size() * sizeof(MeshVertex), packedVertices.data());
+
+	for(size_t i = 0; i < packedVertices.size(); i++){
+		packedVertices[i].unpack(vertices[i]);
+	}
+}
+
+void Graphics::download(BufferAllocation *allocation, VkDeviceSize size, void *data){
+	vulk.flushUploads();
+
+	VkBuffer stagingBuffer;
+	VmaAllocation stagingAllocation;
+	vulk.createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					  stagingBuffer, stagingAllocation, vulk.getPool(MemoryPool::STAGING));
+
+	vulk.copyBuffer(allocation->buffer, stagingBuffer, allocation->offset, 0, size);
+
+	void *stagingData;
+	vmaMapMemory(allocator, stagingAllocation, &stagingData);
+	memcpy(data, stagingData, (size_t) size);
+	vmaUnmapMemory(allocator, stagingAllocation);
+
+	vmaDestroyBuffer(allocator, stagingBuffer, stagingAllocation);
+}
+
+/**
+ * Copies the state of a spring system simulated on the GPU back into its mass points and mesh.
+ */
+void Graphics::syncSystem(SpringSystem *system){
+	simulateSystems();
+	wait();
+
+	// Mass points point into the mesh, so the vertices are copied in place
+	RenderComponent* rObj = system->object->renderComponent;
+	downloadVertices(rObj, rObj->mesh.vertices.data());
+
+	std::vector<glMassPoint> points(system->getNoPoints());
+	download(system->pointBuffer, points.size() * sizeof(glMassPoint), points.data());
+
+	for(int i = 0; i < points.size(); i++){
+		system->getPoint(i)->setVelocity(points[i].velocity);
+	}
+}
+
+/**
+ * Uploads the processor state of a spring system after it was changed outside of the simulation (restoring a
+ * checkpoint).
+ */
+void Graphics::reloadSystem(SpringSystem *system){
+	wait();
+
+	RenderComponent* rObj = system->object->renderComponent;
+	uploadVertices(rObj, 0, rObj->mesh.vertices.size());
+
+	if(system->gpu){
+		deregSystem(system);
+		regSystem(system);
+	}
+}
+
+
+BufferAllocation *Graphics::allocate(VkDeviceSize size, VkBufferUsageFlags bufferUsage, VmaMemoryUsage memoryUsage, VmaPool pool){
 	VkBufferCreateInfo bufferInfo = {};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	bufferInfo.size = size; // the size of the buffer in bytes
 	bufferInfo.usage = bufferUsage;
 
+	// A pool has its own memory type, the usage is only used without one
 	VmaAllocationCreateInfo allocInfo = {};
 	allocInfo.usage = memoryUsage;
+	allocInfo.pool = pool;
 
 	VmaAllocation allocation;
 	VkBuffer buffer;
-	vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &buffer, &allocation, nullptr);
+	if(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &buffer, &allocation, nullptr) != VK_SUCCESS){
+		throw std::runtime_error("failed to allocate buffer!");
+	}
+
+	BufferAllocation* bufferAllocation = new BufferAllocation(buffer, allocation);
+	bufferAllocation->size = size;
+	bufferAllocation->usage = bufferUsage;
+
+	return bufferAllocation;
+}
 
-	return new BufferAllocation(buffer, allocation);
+// Destroys a buffer of allocate() along with its wrapper
+void Graphics::release(BufferAllocation *&allocation){
+	vmaDestroyBuffer(allocator, allocation->buffer, allocation->allocation);
+	delete allocation;
+	allocation = nullptr;
+}
+
+/**
+ * Replaces the buffer of an allocation that defragmentation moved. A buffer stays bound to the memory it was bound to,
+ * so a new one is created with the same parameters and bound to the allocation's new place, the data is already there.
+ */
+void Graphics::rebind(BufferAllocation *allocation){
+	vkDestroyBuffer(vulk.device, allocation->buffer, nullptr);
+
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = allocation->size;
+	bufferInfo.usage = allocation->usage;
+
+	if(vkCreateBuffer(vulk.device, &bufferInfo, nullptr, &allocation->buffer) != VK_SUCCESS){
+		throw std::runtime_error("failed to create buffer!");
+	}
+
+	vmaBindBufferMemory(allocator, allocation->allocation, allocation->buffer);
+}
+
+/**
+ * Compacts the solver buffers of the cloth, which are created and destroyed with the spring systems during a long
+ * session. The allocator copies the moved allocations on the device, every buffer it moved is bound again and whatever
+ * referred to it updated. Geometry buffers (including the spring vertices) aren't moved, their pages are shared by
+ * many objects and only freed when empty.
+ */
+void Graphics::defragment(){
+	wait();
+
+	std::vector<BufferAllocation*> buffers;
+
+	for(SpringSystem* system : Storage::sSystems){
+		if(!system->gpu) continue;
+
+		buffers.insert(buffers.end(), { system->pointBuffer, system->springBuffer, system->pointSpringBuffer, system->neighbourBuffer });
+	}
+
+	std::vector<VmaAllocation> allocations;
+	for(BufferAllocation* buffer : buffers){
+		allocations.push_back(buffer->allocation);
+	}
+
+	std::vector<VkBool32> changed(allocations.size(), VK_FALSE);
+
+	VmaDefragmentationInfo2 info = {};
+	info.allocationCount = static_cast<uint32_t>(allocations.size());
+	info.pAllocations = allocations.data();
+	info.pAllocationsChanged = changed.data();
+	info.maxCpuBytesToMove = VK_WHOLE_SIZE;
+	info.maxCpuAllocationsToMove = UINT32_MAX;
+	info.maxGpuBytesToMove = VK_WHOLE_SIZE;
+	info.maxGpuAllocationsToMove = UINT32_MAX;
+	info.commandBuffer = vulk.beginSingleTimeCommands();
+
+	VmaDefragmentationStats stats = {};
+	VmaDefragmentationContext context;
+	vmaDefragmentationBegin(allocator, &info, &stats, &context);
+
+	// Submits the copies and waits for them
+	vulk.endSingleTimeCommands(info.commandBuffer);
+	vmaDefragmentationEnd(allocator, context);
+
+	for(size_t i = 0; i < buffers.size(); i++){
+		if(changed[i]) rebind(buffers[i]);
+	}
+
+	for(SpringSystem* system : Storage::sSystems){
+		if(!system->gpu) continue;
+
+		vulk.updateClothDescriptorSet(system->descriptorSet, 1, system->pointBuffer);
+		vulk.updateClothDescriptorSet(system->descriptorSet, 2, system->springBuffer);
+		vulk.updateClothDescriptorSet(system->descriptorSet, 3, system->pointSpringBuffer);
+		vulk.updateClothDescriptorSet(system->descriptorSet, 4, system->neighbourBuffer);
+	}
+
+	vulk.invalidateCommandBuffers();
+
+	printf("Defragmented: %u allocations moved, %.1f KiB copied, %u blocks freed\n", stats.allocationsMoved,
+		   stats.bytesMoved / 1024.0, stats.deviceMemoryBlocksFreed);
+	printMemoryStats();
+}
+
+void Graphics::printMemoryStats(){
+	vulk.printMemoryStats();
 }
 
 void Graphics::upload(BufferAllocation *allocation, VkDeviceSize size, void *data){
@@ -90,59 +498,11 @@ void Graphics::upload(BufferAllocation *allocation, VkDeviceSize size, void *dat
  */
 void Graphics::upload(BufferAllocation *allocation, VkDeviceSize size, void *data, VkDeviceSize offset){
 	/**
-	 * We're now using a new stagingBuffer with stagingBufferMemory for mapping and copying the vertex data. In this
-	 * chapter we're going to use two new buffer usage flags:
-	 * - VK_BUFFER_USAGE_TRANSFER_SRC_BIT: Buffer can be used as source in a memory transfer operation.
-	 * - VK_BUFFER_USAGE_TRANSFER_DST_BIT: Buffer can be used as destination in a memory transfer operation.
+	 * The data goes through a staging buffer, host visible memory the GPU copies from into the device local buffer.
+	 * The staging buffers are kept by Vulkan and the copy is only recorded, it is submitted with the other uploads of
+	 * the frame, see Vulkan::queueUpload.
 	 */
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	vulk.createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-						 stagingBuffer, stagingBufferMemory);
-
-	/**
-	 * Fill the buffer
-	 *
-	 * This is done by mapping the buffer memory into CPU accessible memory.
-	 *
-	 * This function allows us to access a region of the specified memory resource defined by an offset and size. The
-	 * offset and size here are 0 and bufferInfo.size, respectively. It is also possible to specify the special value
-	 * VK_WHOLE_SIZE to map all of the memory. The second to last parameter can be used to specify flags, but there
-	 * aren't any available yet in the current API. It must be set to the value 0. The last parameter specifies the
-	 * output for the pointer to the mapped memory.
-	 *
-	 * Simply memcpy the vertex data to the mapped memory and unmap it again
-	 *
-	 * Unfortunately the driver may not immediately copy the data into the buffer memory, for example because of
-	 * caching. It is also possible that writes to the buffer are not visible in the mapped memory yet. There are two
-	 * ways to deal with that problem:
-	 * - Use a memory heap that is host coherent, indicated with VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-	 * - Call vkFlushMappedMemoryRanges to after writing to the mapped memory, and call vkInvalidateMappedMemoryRanges
-	 * 	before reading from the mapped memory
-	 * 	We went for the first approach, which ensures that the mapped memory always matches the contents of the
-	 * 	allocated memory. Do keep in mind that this may lead to slightly worse performance than explicit flushing, but
-	 * 	we'll see why that doesn't matter in the next chapter.
-	 *
-	 * 	Flushing memory ranges or using a coherent memory heap means that the driver will be aware of our writes to the
-	 * 	buffer, but it doesn't mean that they are actually visible on the GPU yet. The transfer of data to the GPU is
-	 * 	an operation that happens in the background and the specification simply tells us that it is guaranteed to be
-	 * 	complete as of the next call to vkQueueSubmit.
-	 */
-	void *stagingData;
-
-	/**
-	 * The vertexBuffer is now allocated from a memory type that is device local, which generally means that we're not
-	 * able to use vkMapMemory. However, we can copy data from the stagingBuffer to the vertexBuffer. We have to
-	 * indicate that we intend to do that by specifying the transfer source flag for the stagingBuffer and the transfer
-	 * destination flag for the vertexBuffer, along with the vertex buffer usage flag.
-	 */
-	vkMapMemory(vulk.device, stagingBufferMemory, 0, size, 0, &stagingData);
-	memcpy(stagingData, data, (size_t) size);
-	vkUnmapMemory(vulk.device, stagingBufferMemory);
-
-	vulk.copyBuffer(stagingBuffer, allocation->buffer, offset, size);
-	vkDestroyBuffer(vulk.device, stagingBuffer, nullptr);
-	vkFreeMemory(vulk.device, stagingBufferMemory, nullptr);
+	vulk.queueUpload(allocation->buffer, allocation->offset + offset, size, data);
 
 	/**
 	 * It should be noted that in a real world application, you're not supposed to actually call vkAllocateMemory
@@ -181,11 +541,20 @@ void Graphics::drawFrame(){
 
 void Graphics::wait(){
 	// Wait to finish processing
+	vulk.flushUploads();
 	vkDeviceWaitIdle(vulk.device);
 }
 
 void Graphics::clear(){
-	vmaDestroyAllocator(allocator);
+	sharedGeometry.clear();
+	vertexGeometry.clear();
+	indexGeometry.clear();
+	lineGeometry.clear();
+
+	if(colliderBuffer != nullptr){
+		release(colliderBuffer);
+		colliderCapacity = 0;
+	}
 }
 
 void Graphics::cleanup(){
@@ -212,20 +581,47 @@ void Graphics::setCamera(){
 void Graphics::setSSystems(){
 	if(drawMesh){
 		for(Spring *spring : Storage::springs){
-			upload(spring->vertexBuffer, spring->vertices.size() * sizeof(Vertex), spring->vertices.data());
+			upload(spring->vertexBuffer, spring->vertices.size() * sizeof(LineVertex), spring->vertices.data());
 		}
 	}
 
 	for(SpringSystem* system : Storage::sSystems){
+		if(system->gpu) continue;
+
+		// Nothing to do while the whole cloth sleeps, otherwise a copy for every range of vertices that moved
+		auto ranges = system->takeMovedRanges(movedTriangles);
+		if(ranges.empty()) continue;
+
 		RenderComponent* rObj = system->object->renderComponent;
-		rObj->calculateNormals();
-		upload(rObj->vertexBuffer, rObj->mesh.vertices.size() * sizeof(Vertex), rObj->mesh.vertices.data());
+
+		// Ranges are in simulated points, a refined mesh is uploaded whole
+		if(system->refinement != nullptr){
+			system->refinement->refine();
+			ranges = { { 0, (uint32_t) rObj->mesh.vertices.size() } };
+
+			if(!rObj->suppliedNormals) rObj->calculateNormals();
+		}else if(!rObj->suppliedNormals){
+			rObj->mesh.calculateNormals(ranges, movedTriangles);
+		}
+
+		for(const std::pair<uint32_t, uint32_t>& range : ranges){
+			uploadVertices(rObj, range.first, range.second);
+		}
 	}
+
+	simulateSystems();
 }
 
 Camera* Graphics::getCamera(){
 	return &camera;
 }
 
+FrameView Graphics::getFrameView(){
+	int width, height;
+	glfwGetFramebufferSize(window, &width, &height);
+
+	return { vulk.uniformBufferObjects.viewProj.view, vulk.uniformBufferObjects.viewProj.proj, (float) height };
+}
+
 Graphics::Graphics() : vulk(), camera(3.0f, 3.0f, 4.0f, 0.4f, 4.0f, 0.0f){ }
 
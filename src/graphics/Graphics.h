@@ -1,10 +1,14 @@
 #ifndef VULK_GRAPHICS_H
 #define VULK_GRAPHICS_H
 
+#include <map>
+#include <memory>
 #include "Vulkan.h"
 #include "Camera.h"
+#include "../interfaces/IFrameBound.h"
 #include "../../VulkanMemoryAllocator/src/vk_mem_alloc.h"
 #include "BufferAllocation.h"
+#include "GeometryBuffer.h"
 #include "RenderComponent.h"
 #include "../curves/Bspline.h"
 #include "../springsystem/Spring.h"
@@ -27,23 +31,72 @@ public:
 	void regObject(RenderComponent *rObj);
 	void deregObject(RenderComponent *rObj);
 
+	void invalidateCommands();
+
 	void regSpring(Spring *spring);
 	void deregSpring(Spring *spring);
 
+	void regSystem(SpringSystem *system);
+	void deregSystem(SpringSystem *system);
+
 	void setSSystems();
+	void simulateSystems();
+	std::vector<Vertex> download(RenderComponent *rObj);
+	void syncSystem(SpringSystem *system);
+	void reloadSystem(SpringSystem *system);
+
+	void defragment();
+	void printMemoryStats();
 
 	Camera* getCamera();
+	FrameView getFrameView();
 	GLFWwindow* window;
 
 private:
 	Vulkan vulk;
 	Camera camera;
-	VmaAllocator allocator;
+	VmaAllocator allocator; // of vulk
+
+	// Vertices and indices of every render object, suballocated. The vertex buffers keep the MeshVertex stream, their
+	// companions the MeshAttributes stream.
+	std::vector<std::unique_ptr<GeometryBuffer>> vertexGeometry;
+	std::vector<std::unique_ptr<GeometryBuffer>> indexGeometry;
+
+	// Line vertices of every spring, suballocated like the mesh vertices
+	std::vector<std::unique_ptr<GeometryBuffer>> lineGeometry;
+
+	// Geometry of the shared render components, one upload per cached mesh
+	struct SharedGeometry {
+		BufferAllocation *vertexBuffer;
+		BufferAllocation *indexBuffer;
+		VkIndexType indexType;
+		unsigned users;
+	};
+
+	std::map<const Mesh*, SharedGeometry> sharedGeometry;
+
+	// Positions and normals packed for an upload or unpacked after a download
+	std::vector<MeshVertex> packedVertices;
+
+	// Triangles the normals of the moved cloth vertices are recomputed from, kept between frames
+	std::vector<uint32_t> movedTriangles;
+
+	BufferAllocation *colliderBuffer = nullptr;
+	size_t colliderCapacity = 0;
 
 	void setCamera();
-	BufferAllocation* allocate(VkDeviceSize size, VkBufferUsageFlags bufferUsage, VmaMemoryUsage memoryUsage);
+	void allocateColliders(size_t capacity);
+	BufferAllocation* allocate(VkDeviceSize size, VkBufferUsageFlags bufferUsage, VmaMemoryUsage memoryUsage, VmaPool pool = VK_NULL_HANDLE);
+	void release(BufferAllocation *&allocation);
+	void rebind(BufferAllocation *allocation);
+	BufferAllocation* allocateGeometry(std::vector<std::unique_ptr<GeometryBuffer>> &buffers, VkDeviceSize size,
+									   VkDeviceSize alignment, VkBufferUsageFlags usage, VkDeviceSize stride = 0,
+									   VkDeviceSize companionStride = 0, VkBufferUsageFlags companionUsage = 0);
 	void upload(BufferAllocation *allocation, VkDeviceSize size, void *data);
 	void upload(BufferAllocation *allocation, VkDeviceSize size, void *data, VkDeviceSize offset);
+	void download(BufferAllocation *allocation, VkDeviceSize size, void *data);
+	void uploadVertices(RenderComponent *rObj, size_t first, size_t last);
+	void downloadVertices(RenderComponent *rObj, Vertex *vertices);
 };
 
 
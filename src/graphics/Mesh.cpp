@@ -1,11 +1,12 @@
+#include <algorithm>
 #include <sstream>
 #include "Mesh.h"
 
-Mesh::Mesh(const std::vector<Vertex> &vertices, const std::vector<uint16_t> &indices) : vertices(vertices), indices(indices){ }
+Mesh::Mesh(const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices) : vertices(vertices), indices(indices){ }
 
 Mesh Mesh::generateSphere(float radius, int sectorCount, int stackCount){
 	std::vector<Vertex> vertices;
-	std::vector<uint16_t> indices;
+	std::vector<uint32_t> indices;
 
 	float x, y, z, xy;                              // vertex position
 
@@ -71,7 +72,7 @@ Mesh Mesh::generatePlane(glm::vec2 start, glm::vec2 end, int n, bool alt){
 	glm::vec2 inc = (end - start) / (float) n;
 
 	std::vector<Vertex> vertices;
-	std::vector<uint16_t> indices;
+	std::vector<uint32_t> indices;
 
 	for(int i = 0; i < n; i++){
 		for(int j = 0; j < n; j++){
@@ -110,7 +111,7 @@ Mesh Mesh::load(const std::string &filename){
 	}
 
 	std::vector<Vertex> vertices;
-	std::vector<uint16_t> indices;
+	std::vector<uint32_t> indices;
 
 	std::string line;
 	std::stringstream ss;
@@ -137,4 +138,61 @@ Mesh Mesh::load(const std::string &filename){
 	file.close();
 
 	return Mesh(vertices, indices);
-}
\ No newline at end of file
+}
+
+VkIndexType Mesh::indexType() const{
+	return vertices.size() <= UINT16_MAX + 1 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+}
+
+std::vector<uint16_t> Mesh::shortIndices() const{
+	return std::vector<uint16_t>(indices.begin(), indices.end());
+}
+
+void Mesh::calculateNormals(){
+	for(int i = 0; i < indices.size(); i += 3){
+		glm::vec3 vertA = vertices[indices[i+0]].pos;
+		glm::vec3 vertB = vertices[indices[i+1]].pos;
+		glm::vec3 vertC = vertices[indices[i+2]].pos;
+
+		glm::vec3 lineA = vertB - vertA;
+		glm::vec3 lineB = vertC - vertB;
+
+		glm::vec3 faceNormal = glm::cross(lineA, lineB);
+
+		vertices[indices[i+0]].normal += faceNormal;
+		vertices[indices[i+1]].normal += faceNormal;
+		vertices[indices[i+2]].normal += faceNormal;
+	}
+
+	for(int i = 0; i < vertices.size(); i++){
+		vertices[i].normal = glm::normalize(vertices[i].normal);
+	}
+}
+
+void Mesh::calculateNormals(const std::vector<std::pair<uint32_t, uint32_t>> &ranges, const std::vector<uint32_t> &triangles){
+	auto inRanges = [&](uint32_t vertex){
+		auto range = std::upper_bound(ranges.begin(), ranges.end(), vertex, [](uint32_t v, const std::pair<uint32_t, uint32_t>& r){
+			return v < r.first;
+		});
+
+		return range != ranges.begin() && vertex < (range - 1)->second;
+	};
+
+	for(uint32_t i : triangles){
+		glm::vec3 vertA = vertices[indices[i+0]].pos;
+		glm::vec3 vertB = vertices[indices[i+1]].pos;
+		glm::vec3 vertC = vertices[indices[i+2]].pos;
+
+		glm::vec3 faceNormal = glm::cross(vertB - vertA, vertC - vertB);
+
+		for(int k = 0; k < 3; k++){
+			if(inRanges(indices[i+k])) vertices[indices[i+k]].normal += faceNormal;
+		}
+	}
+
+	for(const std::pair<uint32_t, uint32_t>& range : ranges){
+		for(uint32_t i = range.first; i < range.second; i++){
+			vertices[i].normal = glm::normalize(vertices[i].normal);
+		}
+	}
+}
@@ -2,20 +2,31 @@
 #define VULK_MESH_H
 
 
+#include <utility>
 #include <vector>
 #include "Vulkan.h"
 
 class Mesh {
 public:
-	Mesh(const std::vector<Vertex> &vertices, const std::vector<uint16_t> &indices);
+	Mesh(const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices);
 
 	static Mesh generateSphere(float r, int sectorCount, int stackCount);
 	static Mesh generatePlane(glm::vec2 start, glm::vec2 end, int n);
 	static Mesh generatePlane(glm::vec2 start, glm::vec2 end, int n, bool alt);
 	static Mesh load(const std::string &filename);
 
+	// Narrowest index type able to address every vertex, 16-bit indices halve the index buffer
+	VkIndexType indexType() const;
+	std::vector<uint16_t> shortIndices() const;
+
+	// Adds the face normals to the vertex normals and normalizes them
+	void calculateNormals();
+
+	// Same for the vertices in the sorted ranges only, triangles lists the first index of every triangle touching them
+	void calculateNormals(const std::vector<std::pair<uint32_t, uint32_t>> &ranges, const std::vector<uint32_t> &triangles);
+
 	std::vector<Vertex> vertices;
-	std::vector<uint16_t> indices;
+	std::vector<uint32_t> indices;
 };
 
 
@@ -0,0 +1,54 @@
+#include "MeshCache.h"
+
+std::mutex MeshCache::mutex;
+std::map<MeshCache::Key, std::shared_ptr<const Mesh>> MeshCache::meshes;
+std::map<std::tuple<std::string, uint64_t, uint64_t>, std::shared_ptr<const Mesh>> MeshCache::files;
+
+std::shared_ptr<const Mesh> MeshCache::sphere(float r, int sectorCount, int stackCount){
+	return get(Key(0, r, 0, 0, 0, sectorCount, stackCount), [&]{
+		return Mesh::generateSphere(r, sectorCount, stackCount);
+	});
+}
+
+std::shared_ptr<const Mesh> MeshCache::plane(glm::vec2 start, glm::vec2 end, int n, bool alt){
+	return get(Key(1, start.x, start.y, end.x, end.y, n, alt), [&]{
+		return Mesh::generatePlane(start, end, n, alt);
+	});
+}
+
+std::shared_ptr<const Mesh> MeshCache::stored(const std::string &filename, uint64_t vertexOffset, uint64_t indexOffset,
+											   const std::function<Mesh()> &load){
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto key = std::make_tuple(filename, vertexOffset, indexOffset);
+
+	auto it = files.find(key);
+	if(it == files.end()){
+		it = files.emplace(key, prepare(load())).first;
+	}
+
+	return it->second;
+}
+
+void MeshCache::clear(){
+	std::lock_guard<std::mutex> lock(mutex);
+	meshes.clear();
+	files.clear();
+}
+
+template<typename Generate>
+std::shared_ptr<const Mesh> MeshCache::get(const Key &key, Generate generate){
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto it = meshes.find(key);
+	if(it == meshes.end()){
+		it = meshes.emplace(key, prepare(generate())).first;
+	}
+
+	return it->second;
+}
+
+std::shared_ptr<const Mesh> MeshCache::prepare(Mesh mesh){
+	mesh.calculateNormals();
+	return std::make_shared<const Mesh>(std::move(mesh));
+}
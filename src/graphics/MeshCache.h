@@ -0,0 +1,42 @@
+#ifndef VULK_MESHCACHE_H
+#define VULK_MESHCACHE_H
+
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include "Mesh.h"
+
+/**
+ * Generated and loaded meshes with their normals, built once and shared read-only by every scene that asks for the same
+ * one. Static render components keep a reference to the cached mesh, share its geometry on the GPU and are drawn
+ * instanced, see Graphics::regObject. The cloth copies the mesh so it can move its own vertices.
+ */
+class MeshCache {
+public:
+	static std::shared_ptr<const Mesh> sphere(float r, int sectorCount, int stackCount);
+	static std::shared_ptr<const Mesh> plane(glm::vec2 start, glm::vec2 end, int n, bool alt = false);
+	// Mesh stored in a scene file, identified by the offsets of its arrays. load() builds it on the first request
+	static std::shared_ptr<const Mesh> stored(const std::string &filename, uint64_t vertexOffset, uint64_t indexOffset,
+											  const std::function<Mesh()> &load);
+
+	static void clear();
+
+private:
+	// Kind of mesh followed by its generation arguments
+	typedef std::tuple<int, float, float, float, float, int, int> Key;
+
+	static std::mutex mutex;
+	static std::map<Key, std::shared_ptr<const Mesh>> meshes;
+	static std::map<std::tuple<std::string, uint64_t, uint64_t>, std::shared_ptr<const Mesh>> files;
+
+	template<typename Generate>
+	static std::shared_ptr<const Mesh> get(const Key &key, Generate generate);
+	static std::shared_ptr<const Mesh> prepare(Mesh mesh);
+};
+
+
+#endif //VULK_MESHCACHE_H
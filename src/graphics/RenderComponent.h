@@ -3,10 +3,12 @@
 
 
 #include <cstdint>
+#include <memory>
 #include <vector>
 #include "Vulkan.h"
 #include "Mesh.h"
 #include "BufferAllocation.h"
+#include "../storage/ComponentRegistry.h"
 
 struct MeshTransforms {
 	glm::mat4 tObject;
@@ -16,19 +18,32 @@ struct MeshTransforms {
 class RenderComponent {
 public:
 	RenderComponent(const Mesh &mesh);
+	explicit RenderComponent(std::shared_ptr<const Mesh> cached);
 
 	void calculateNormals();
+	const Mesh& getMesh() const;
 
-	static MeshTransforms identity;
-
+	// Own copy of the mesh that the cloth moves, empty for components drawing a cached mesh
 	Mesh mesh;
 
-	MeshTransforms transforms;
+	// Read-only mesh of MeshCache, not copied. Its geometry is uploaded once for all the components drawing it.
+	std::shared_ptr<const Mesh> sharedMesh;
+
+	// Slot in Storage::transforms, shared with the owning world object
+	uint32_t transformSlot = 0;
+	const MeshTransforms& getTransforms() const;
+
 	BufferAllocation *vertexBuffer = nullptr;
 
 	BufferAllocation *indexBuffer = nullptr;
+	VkIndexType indexType = VK_INDEX_TYPE_UINT16;
 
 	unsigned pipeline;
+
+	// Normals come with the vertices (simulation cache playback) and aren't recomputed before uploading
+	bool suppliedNormals = false;
+
+	Handle handle;
 private:
 };
 
@@ -0,0 +1,44 @@
+#include <stdexcept>
+#include "Shaders.h"
+
+/*
+ * Every .spv file becomes a read-only symbol pair marking its start and end. The Makefile compiles the shaders before
+ * this file, the paths are relative to the directory make runs in. SPIR-V is read as 32 bit words, hence the alignment.
+ */
+#define EMBED_SHADER(symbol, file) \
+	__asm__(".section .rodata\n" \
+			".balign 4\n" \
+			".global " #symbol "Start\n" \
+			#symbol "Start:\n" \
+			".incbin \"" file "\"\n" \
+			".global " #symbol "End\n" \
+			#symbol "End:\n" \
+			".previous\n"); \
+	extern "C" const char symbol##Start[]; \
+	extern "C" const char symbol##End[];
+
+EMBED_SHADER(topoVert, "shaders/topo.vert.spv")
+EMBED_SHADER(topoFrag, "shaders/topo.frag.spv")
+EMBED_SHADER(lineVert, "shaders/line.vert.spv")
+EMBED_SHADER(lineFrag, "shaders/line.frag.spv")
+EMBED_SHADER(clothComp, "shaders/cloth.comp.spv")
+
+ShaderCode getShader(const std::string &name){
+	static const struct {
+		const char* name;
+		const char* start;
+		const char* end;
+	} shaders[] = {
+			{ "topo.vert", topoVertStart, topoVertEnd },
+			{ "topo.frag", topoFragStart, topoFragEnd },
+			{ "line.vert", lineVertStart, lineVertEnd },
+			{ "line.frag", lineFragStart, lineFragEnd },
+			{ "cloth.comp", clothCompStart, clothCompEnd }
+	};
+
+	for(const auto& shader : shaders){
+		if(name == shader.name) return { shader.start, (size_t) (shader.end - shader.start) };
+	}
+
+	throw std::runtime_error("unknown shader " + name + "!");
+}
@@ -0,0 +1,19 @@
+#ifndef VULK_SHADERS_H
+#define VULK_SHADERS_H
+
+
+#include <cstddef>
+#include <string>
+
+/**
+ * SPIR-V of a shader from shaders/, assembled into the binary so nothing is read from disk at startup.
+ */
+struct ShaderCode {
+	const char* data;
+	size_t size;
+};
+
+ShaderCode getShader(const std::string &name);
+
+
+#endif //VULK_SHADERS_H
@@ -1,11 +1,17 @@
+#include <algorithm>
+#include <cstdio>
+#include <tuple>
 #include "Vulkan.h"
 #include "../utils.h"
 #include "../storage/Storage.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "../stb_image.h"
 #include "../Game.h"
+#include "../data.h"
+#include "../physics/PhysicsEngine.h"
 
 void Vulkan::init(){
+	initStart = std::chrono::high_resolution_clock::now();
 	initMisc();
 	initWindow();
 	initVulkan();
@@ -58,13 +64,20 @@ void Vulkan::initVulkan(){
 	createSurface();
 	pickPhysicalDevice();
 	createLogicalDevice();
+	createAllocator();
 	createSwapChain();
 	createImageViews();
 
 	// Vulkan pipeline
 	createRenderPass();
 	createDescriptorSetLayouts();
+	createPipelineCache();
+
+	auto pipelineStart = std::chrono::high_resolution_clock::now();
+	auto compute = std::async(std::launch::async, [this]{ createComputePipeline(); });
 	createGraphicsPipeline();
+	compute.get();
+	pipelineTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - pipelineStart).count();
 
 	// Drawing
 	createCommandPool();
@@ -73,10 +86,12 @@ void Vulkan::initVulkan(){
 	//createVertexBuffer(); // not in recreate
 	//createIndexBuffer();
 	createUniformBuffers();
+	createIndirectBuffers();
 	createDescriptorPool();
 	createDescriptorSets();
 	createCommandBuffers();
 	createSyncObjects();
+	createTransferBatches();
 }
 
 /**
@@ -113,6 +128,7 @@ void Vulkan::recreateSwapChain() {
 	createDepthResources();
 	createFramebuffers();
 	createUniformBuffers();
+	createIndirectBuffers();
 	createDescriptorPool();
 	createDescriptorSets();
 	createCommandBuffers();
@@ -126,6 +142,13 @@ void Vulkan::cleanup(){
 
 	vkDestroyDescriptorSetLayout(device, descriptorSets[0].layout, nullptr);
 	vkDestroyDescriptorSetLayout(device, descriptorSets[1].layout, nullptr);
+	vkDestroyDescriptorSetLayout(device, descriptorSets[2].layout, nullptr);
+
+	vkDestroyPipeline(device, computePipeline, nullptr);
+	vkDestroyPipelineLayout(device, computePipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(device, computeSetLayout, nullptr);
+	vkDestroyDescriptorPool(device, computeDescriptorPool, nullptr);
+	vkDestroyFence(device, computeFence, nullptr);
 
 	for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++){
 		vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
@@ -133,8 +156,23 @@ void Vulkan::cleanup(){
 		vkDestroyFence(device, inFlightFences[i], nullptr);
 	}
 
+	destroyTransferBatches();
+
 	vkDestroyCommandPool(device, commandPool, nullptr);
 
+	if(transferPool != VK_NULL_HANDLE){
+		vkDestroyCommandPool(device, transferPool, nullptr);
+	}
+
+	for(VkCommandPool drawPool : drawPools){
+		vkDestroyCommandPool(device, drawPool, nullptr);
+	}
+
+	savePipelineCache();
+	vkDestroyPipelineCache(device, pipelineCache, nullptr);
+
+	destroyAllocator();
+
 	vkDestroyDevice(device, nullptr);
 
 	if(enableValidationLayers){
@@ -153,13 +191,18 @@ void Vulkan::cleanup(){
 void Vulkan::cleanupSwapChain(){
 	vkDestroyImageView(device, depthImageView, nullptr);
 	vkDestroyImage(device, depthImage, nullptr);
-	vkFreeMemory(device, depthImageMemory, nullptr);
+	vmaFreeMemory(allocator, depthImageAllocation);
 
 	for (size_t i = 0; i < swapChainFramebuffers.size(); i++) {
 		vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr);
 	}
 
 	vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+	vkFreeCommandBuffers(device, commandPool, 1, &computeCommandBuffer);
+
+	for(size_t c = 0; c < secondaryBuffers.size(); c++){
+		vkFreeCommandBuffers(device, drawPools[c], static_cast<uint32_t>(secondaryBuffers[c].size()), secondaryBuffers[c].data());
+	}
 
 	for(VkPipeline pipeline : graphicsPipelines){
 		vkDestroyPipeline(device, pipeline, nullptr);
@@ -175,12 +218,14 @@ void Vulkan::cleanupSwapChain(){
 
 	vkDestroySwapchainKHR(device, swapChain, nullptr);
 
+	destroyUniformBuffers();
+
 	for (size_t i = 0; i < swapChainImages.size(); i++) {
-		vkDestroyBuffer(device, uniformBuffers[0].buffer[i], nullptr);
-		vkFreeMemory(device, uniformBuffers[0].memory[i], nullptr);
+		vmaUnmapMemory(allocator, indirectBuffers.allocation[i]);
+		vmaDestroyBuffer(allocator, indirectBuffers.buffer[i], indirectBuffers.allocation[i]);
 
-		vkDestroyBuffer(device, uniformBuffers[1].buffer[i], nullptr);
-		vkFreeMemory(device, uniformBuffers[1].memory[i], nullptr);
+		vmaUnmapMemory(allocator, instanceBuffers.allocation[i]);
+		vmaDestroyBuffer(allocator, instanceBuffers.buffer[i], instanceBuffers.allocation[i]);
 	}
 
 	vkDestroyDescriptorPool(device, descriptorPool, nullptr);
@@ -233,19 +278,46 @@ void Vulkan::drawFrame(){
 		throw std::runtime_error("failed to acquire swap chain image!");
 	}
 
-	// Update the unofmr buffer (MVP matrices)
+	// The image may still be drawn by an earlier frame, its buffers can't change before that is done
+	if(imagesInFlight[imageIndex] != VK_NULL_HANDLE){
+		vkWaitForFences(device, 1, &imagesInFlight[imageIndex], VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+	imagesInFlight[imageIndex] = inFlightFences[currentFrame];
+
+	// Update the unofmr buffer (MVP matrices) and the object transforms
 	updateUniformBuffer(imageIndex);
 
-	// Record the command buffer
-	recordCommandBuffer(imageIndex);
+	// Record the command buffer if anything it draws changed
+	if(commandBufferDirty[imageIndex] || drawBench){
+		auto start = std::chrono::high_resolution_clock::now();
+
+		recordCommandBuffer(imageIndex);
+		commandBufferDirty[imageIndex] = false;
+
+		if(drawBench){
+			recordTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+			if(++recordCount == DRAW_BENCH_FRAMES){
+				printf("Recorded %u draws in %.3f ms on %zu threads\n", (unsigned) (Storage::renderObjects.size() + (drawMesh ? Storage::springs.size() : 0)),
+					   recordTime / recordCount, std::max<size_t>(drawPools.size(), 1));
+				recordTime = 0;
+				recordCount = 0;
+			}
+		}
+	}
+
+	// Uploads queued since the last flush go first
+	flushUploads();
 
 	// Submit the command buffer
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-	VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
-	VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-	submitInfo.waitSemaphoreCount = 1;
+	// With a transfer queue, the signal of the previous frame has to be waited for before it is signaled again, by
+	// the uploads or here if there were none
+	VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame], pendingDrawSemaphore};
+	VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT};
+	submitInfo.waitSemaphoreCount = pendingDrawSemaphore != VK_NULL_HANDLE ? 2 : 1;
 	submitInfo.pWaitSemaphores = waitSemaphores;
 	submitInfo.pWaitDstStageMask = waitStages;
 
@@ -254,10 +326,15 @@ void Vulkan::drawFrame(){
 	submitInfo.pCommandBuffers = &commandBuffers[imageIndex];
 
 	// Which semaphores to signal once the command buffer(s) have finished execution
-	VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
+	VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame], VK_NULL_HANDLE};
 	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores = signalSemaphores;
 
+	if(transferQueue != VK_NULL_HANDLE){
+		signalSemaphores[1] = drawSemaphores[currentFrame];
+		submitInfo.signalSemaphoreCount = 2;
+	}
+
 	// Lock frame
 	vkResetFences(device, 1, &inFlightFences[currentFrame]);
 
@@ -271,6 +348,10 @@ void Vulkan::drawFrame(){
 		printf("foo\n");
 	}
 
+	if(transferQueue != VK_NULL_HANDLE){
+		pendingDrawSemaphore = drawSemaphores[currentFrame];
+	}
+
 	// Presentation
 
 	VkPresentInfoKHR presentInfo = {};
@@ -303,6 +384,13 @@ void Vulkan::drawFrame(){
 		throw std::runtime_error("failed to present swap chain image!");
 	}
 
+	if(firstFrame){
+		firstFrame = false;
+		printf("First frame after %.1f ms, pipelines created in %.1f ms (pipeline cache %s)\n",
+				std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - initStart).count(),
+				pipelineTime, pipelineCacheHit ? "hit" : "miss");
+	}
+
 
 	// vkQueueWaitIdle(presentQueue);
 	currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
@@ -318,10 +406,16 @@ void Vulkan::updateUniformBuffer(uint32_t currentImage){
 	uniformBufferObjects.viewProj.proj = glm::perspective(glm::radians(45.0f), swapChainExtent.width / (float) swapChainExtent.height, 0.1f, 10.0f);
 	uniformBufferObjects.viewProj.proj[1][1] *= -1;
 
-	void* data;
-	vkMapMemory(device, uniformBuffers[0].memory[currentImage], 0, sizeof(UBOViewProj), 0, &data);
+	// Growing replaces the ring, so it happens before anything is allocated from it
+	if(Storage::transforms.size() > transformCapacity){
+		growTransformBuffers(std::max(Storage::transforms.size(), 2 * transformCapacity));
+	}
+
+	beginUniforms(currentImage);
+	std::array<uint32_t, 3> offsets;
+
+	void* data = allocateUniforms(sizeof(UBOViewProj), offsets[0]);
 	memcpy(data, &uniformBufferObjects.viewProj, sizeof(UBOViewProj));
-	vkUnmapMemory(device, uniformBuffers[0].memory[currentImage]);
 
 	// Lights UBO
 
@@ -329,9 +423,60 @@ void Vulkan::updateUniformBuffer(uint32_t currentImage){
 	uniformBufferObjects.lights.lights[0].pos = glm::vec3(3, 3, 10.0f);
 	uniformBufferObjects.lights.lights[0].color = glm::vec3(1.0f, 1.0f, 1.0f);
 
-	vkMapMemory(device, uniformBuffers[1].memory[currentImage], 0, sizeof(UBOLights), 0, &data);
+	data = allocateUniforms(sizeof(UBOLights), offsets[1]);
 	memcpy(data, &uniformBufferObjects.lights, sizeof(UBOLights));
-	vkUnmapMemory(device, uniformBuffers[1].memory[currentImage]);
+
+	// Transforms SSBO, indexed by the instance index of every draw. The whole capacity is allocated, it is the range
+	// of the descriptor.
+
+	data = allocateUniforms(transformCapacity * sizeof(MeshTransforms), offsets[2]);
+	memcpy(data, Storage::transforms.data(), Storage::transforms.size() * sizeof(MeshTransforms));
+
+	// The command buffer of the image binds the sets at the offsets of the last time it was recorded
+	if(offsets != uniformOffsets[currentImage]){
+		uniformOffsets[currentImage] = offsets;
+		commandBufferDirty[currentImage] = true;
+	}
+}
+
+/**
+ * Starts allocating from the slice of an image, dropping whatever the image's previous frame allocated.
+ */
+void Vulkan::beginUniforms(uint32_t image){
+	uniformRing.head = image * uniformRing.sliceSize;
+	uniformRing.end = uniformRing.head + uniformRing.sliceSize;
+}
+
+/**
+ * Sub-allocates per-frame data from the uniform ring. Returns where to write it, offset is the dynamic offset to bind
+ * it with.
+ */
+void* Vulkan::allocateUniforms(VkDeviceSize size, uint32_t &offset){
+	VkDeviceSize start = (uniformRing.head + uniformRing.alignment - 1) / uniformRing.alignment * uniformRing.alignment;
+	if(start + size > uniformRing.end){
+		throw std::runtime_error("uniform ring slice is full!");
+	}
+
+	uniformRing.head = start + size;
+	offset = static_cast<uint32_t>(start);
+
+	return uniformRing.data + start;
+}
+
+/**
+ * Replaces the uniform ring with one whose slices fit more transforms. Descriptor sets that are bound in recorded
+ * command buffers can't be updated, so this waits for the device and records everything again.
+ */
+void Vulkan::growTransformBuffers(size_t capacity){
+	vkDeviceWaitIdle(device);
+
+	destroyUniformBuffers();
+	transformCapacity = capacity;
+	createUniformBuffers();
+
+	writeUniformDescriptors();
+
+	invalidateCommandBuffers();
 }
 
 void Vulkan::createInstance(){
@@ -522,22 +667,24 @@ bool Vulkan::checkDeviceExtensionSupport(VkPhysicalDevice device){
 }
 
 /**
- * Create logical device with one Graphics and  one Present queue family. Also retrieves the queue families.
+ * Create logical device with one Graphics and  one Present queue family, and a transfer queue if the device has one to
+ * spare. Also retrieves the queue families.
  */
 void Vulkan::createLogicalDevice(){
 	QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
 	std::vector <VkDeviceQueueCreateInfo> queueCreateInfos;
 	std::set <uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+	if(indices.transferFamily.has_value()) uniqueQueueFamilies.insert(indices.transferFamily.value());
 
-	float queuePriority = 1.0f;
+	float queuePriorities[] = { 1.0f, 1.0f };
 
 	for(uint32_t queueFamily : uniqueQueueFamilies){
 		VkDeviceQueueCreateInfo queueCreateInfo = {};
 		queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
 		queueCreateInfo.queueFamilyIndex = queueFamily;
-		queueCreateInfo.queueCount = 1;
-		queueCreateInfo.pQueuePriorities = &queuePriority;
+		queueCreateInfo.queueCount = queueFamily == indices.transferFamily ? indices.transferQueueIndex + 1 : 1;
+		queueCreateInfo.pQueuePriorities = queuePriorities;
 		queueCreateInfos.push_back(queueCreateInfo);
 	}
 
@@ -547,10 +694,21 @@ void Vulkan::createLogicalDevice(){
 	createInfo.pQueueCreateInfos = queueCreateInfos.data();
 	createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
 	VkPhysicalDeviceFeatures deviceFeatures = {};
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
+	deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+	deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
 	createInfo.pEnabledFeatures = &deviceFeatures;
 
+	indirectDraws = supportedFeatures.drawIndirectFirstInstance;
+	maxIndirectDraws = supportedFeatures.multiDrawIndirect ? properties.limits.maxDrawIndirectCount : 1;
+
 	createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
 	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
@@ -567,6 +725,88 @@ void Vulkan::createLogicalDevice(){
 
 	vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
 	vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+
+	graphicsFamily = indices.graphicsFamily.value();
+
+	if(indices.transferFamily.has_value()){
+		transferFamily = indices.transferFamily.value();
+		vkGetDeviceQueue(device, transferFamily, indices.transferQueueIndex, &transferQueue);
+	}
+}
+
+/**
+ * One allocator for the whole run, so scene loads reuse its memory blocks instead of allocating them again. Buffers of
+ * the pools in MemoryPool are only allocated from their own blocks.
+ */
+void Vulkan::createAllocator(){
+	VmaAllocatorCreateInfo allocatorInfo = {};
+	allocatorInfo.physicalDevice = physicalDevice;
+	allocatorInfo.device = device;
+
+	if(vmaCreateAllocator(&allocatorInfo, &allocator) != VK_SUCCESS){
+		throw std::runtime_error("failed to create memory allocator!");
+	}
+
+	createPool(MemoryPool::GEOMETRY, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+			   VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+	createPool(MemoryPool::CLOTH, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			   VMA_MEMORY_USAGE_GPU_ONLY);
+	createPool(MemoryPool::STAGING, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+}
+
+/**
+ * A pool has a single memory type, picked for the usage of every buffer that will be allocated from it.
+ */
+void Vulkan::createPool(MemoryPool pool, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage){
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = 1024;
+	bufferInfo.usage = usage;
+
+	VmaAllocationCreateInfo allocInfo = {};
+	allocInfo.usage = memoryUsage;
+
+	VmaPoolCreateInfo poolInfo = {};
+	if(vmaFindMemoryTypeIndexForBufferInfo(allocator, &bufferInfo, &allocInfo, &poolInfo.memoryTypeIndex) != VK_SUCCESS){
+		throw std::runtime_error("failed to find a memory type for a pool!");
+	}
+
+	if(vmaCreatePool(allocator, &poolInfo, &pools[(size_t) pool]) != VK_SUCCESS){
+		throw std::runtime_error("failed to create memory pool!");
+	}
+}
+
+void Vulkan::destroyAllocator(){
+	for(VmaPool pool : pools){
+		vmaDestroyPool(allocator, pool);
+	}
+
+	vmaDestroyAllocator(allocator);
+}
+
+VmaPool Vulkan::getPool(MemoryPool pool) const{
+	return pools[(size_t) pool];
+}
+
+/**
+ * Used and reserved memory of every pool and of the whole allocator.
+ */
+void Vulkan::printMemoryStats(){
+	static const char* names[MEMORY_POOLS] = { "geometry", "cloth", "staging" };
+
+	printf("Memory:");
+	for(size_t i = 0; i < MEMORY_POOLS; i++){
+		VmaPoolStats stats;
+		vmaGetPoolStats(allocator, pools[i], &stats);
+
+		printf(" %s %.1f/%.1f MiB in %zu blocks,", names[i], (stats.size - stats.unusedSize) / 1048576.0, stats.size / 1048576.0,
+			   stats.blockCount);
+	}
+
+	VmaStats stats;
+	vmaCalculateStats(allocator, &stats);
+	printf(" total %.1f/%.1f MiB\n", stats.total.usedBytes / 1048576.0,
+		   (stats.total.usedBytes + stats.total.unusedBytes) / 1048576.0);
 }
 
 /**
@@ -894,10 +1134,11 @@ void Vulkan::createRenderPass(){
  * https://vulkan-tutorial.com/Uniform_buffers/Descriptor_layout_and_buffer
  */
 void Vulkan::createDescriptorSetLayouts(){
-	descriptorSets.resize(2);
+	descriptorSets.resize(3);
 
-	createDescriptorSetLayout(VK_SHADER_STAGE_VERTEX_BIT, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &descriptorSets[0].layout);
-	createDescriptorSetLayout(VK_SHADER_STAGE_FRAGMENT_BIT, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &descriptorSets[1].layout);
+	createDescriptorSetLayout(VK_SHADER_STAGE_VERTEX_BIT, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 0, &descriptorSets[0].layout);
+	createDescriptorSetLayout(VK_SHADER_STAGE_FRAGMENT_BIT, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 0, &descriptorSets[1].layout);
+	createDescriptorSetLayout(VK_SHADER_STAGE_VERTEX_BIT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 0, &descriptorSets[2].layout);
 }
 
 void Vulkan::createDescriptorSetLayout(VkShaderStageFlags stageFlags, VkDescriptorType descriptorType, uint32_t binding, VkDescriptorSetLayout *layout){
@@ -976,16 +1217,23 @@ void Vulkan::createGraphicsPipeline(){
 
 	pipelineLayouts.resize(3);
 	graphicsPipelines.resize(3);
+
+	/**
+	 * Pipeline creation doesn't need external synchronization, not even of the pipeline cache, so the pipelines are
+	 * compiled on their own threads. Each of them only writes its own slot of pipelineLayouts and graphicsPipelines.
+	 */
+	auto line = std::async(std::launch::async, [this]{ createLinePipeline(); });
+	auto cloth = std::async(std::launch::async, [this]{ createClothPipeline(); });
 	createTopoPipeline();
-	createLinePipeline();
-	createClothPipeline();
+	line.get();
+	cloth.get();
 
 	// Pipeline creation
 	/**
-	 * The second parameter, for which we've passed the VK_NULL_HANDLE argument, references an optional
-	 * VkPipelineCache object. A pipeline cache can be used to store and reuse data relevant to pipeline creation
-	 * across multiple calls to vkCreateGraphicsPipelines and even across program executions if the cache is stored
-	 * to a file. This makes it possible to significantly speed up pipeline creation at a later time.
+	 * The second parameter references an optional VkPipelineCache object. A pipeline cache can be used to store and
+	 * reuse data relevant to pipeline creation across multiple calls to vkCreateGraphicsPipelines and even across
+	 * program executions if the cache is stored to a file. This makes it possible to significantly speed up pipeline
+	 * creation at a later time, see createPipelineCache.
 	 */
 	/*if(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, pipelineInfos.size(), pipelineInfos.data(), nullptr, graphicsPipelines.data()) !=
 	   VK_SUCCESS){
@@ -997,6 +1245,82 @@ void Vulkan::createGraphicsPipeline(){
 	vkDestroyShaderModule(device, vertShaderModule, nullptr);*/
 }
 
+/**
+ * Loads the pipeline cache of the previous run. The driver is free to ignore data it doesn't recognize, but not every
+ * one does so gracefully, so the header is checked against the device first: data written by another device, driver
+ * version or a truncated file starts an empty cache instead.
+ */
+void Vulkan::createPipelineCache(){
+	std::vector<char> data;
+
+	std::ifstream file(PIPELINE_CACHE_FILE, std::ios::ate | std::ios::binary);
+	if(file.is_open()){
+		data.resize((size_t) file.tellg());
+		file.seekg(0);
+		file.read(data.data(), data.size());
+		if(!file || !validPipelineCache(data)){
+			data.clear();
+		}
+	}
+
+	pipelineCacheHit = !data.empty();
+
+	VkPipelineCacheCreateInfo cacheInfo = {};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheInfo.initialDataSize = data.size();
+	cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+	if(vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS){
+		throw std::runtime_error("failed to create pipeline cache!");
+	}
+}
+
+/**
+ * The cache data starts with a header of the length, version, vendor, device and cache UUID of the device that wrote it.
+ */
+bool Vulkan::validPipelineCache(const std::vector<char> &data){
+	struct {
+		uint32_t size;
+		uint32_t version;
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint8_t uuid[VK_UUID_SIZE];
+	} header;
+
+	if(data.size() < sizeof(header)) return false;
+	memcpy(&header, data.data(), sizeof(header));
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	return header.size >= sizeof(header) && header.version == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+		   header.vendorID == properties.vendorID && header.deviceID == properties.deviceID &&
+		   memcmp(header.uuid, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+/**
+ * Written to a temporary file first, so a crash while saving doesn't leave a truncated cache behind.
+ */
+void Vulkan::savePipelineCache(){
+	size_t size = 0;
+	if(vkGetPipelineCacheData(device, pipelineCache, &size, nullptr) != VK_SUCCESS || size == 0) return;
+
+	std::vector<char> data(size);
+	if(vkGetPipelineCacheData(device, pipelineCache, &size, data.data()) != VK_SUCCESS) return;
+
+	std::string temporary = std::string(PIPELINE_CACHE_FILE) + ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		file.write(data.data(), size);
+		if(!file){
+			std::cerr << "failed to write " << temporary << std::endl;
+			return;
+		}
+	}
+
+	std::rename(temporary.c_str(), PIPELINE_CACHE_FILE);
+}
+
 void Vulkan::createTopoPipeline(){
 	// Shader Stages
 	/**
@@ -1006,8 +1330,8 @@ void Vulkan::createTopoPipeline(){
 	 * http://www.mattikariluoma.com/blog/Segmentation%20Fault%20during%20vkCreateGraphicsPipelines.html
 	 */
 
-	auto vertShaderCode = readFile("shaders/topo.vert.spv");
-	auto fragShaderCode = readFile("shaders/topo.frag.spv");
+	auto vertShaderCode = getShader("topo.vert");
+	auto fragShaderCode = getShader("topo.frag");
 
 	VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
 	VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
@@ -1033,12 +1357,12 @@ void Vulkan::createTopoPipeline(){
 	 */
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
 
-	auto bindingDescription = Vertex::getBindingDescription();
-	auto attributeDescriptions = Vertex::getAttributeDescriptions();
+	auto bindingDescriptions = MeshVertex::getBindingDescriptions();
+	auto attributeDescriptions = MeshVertex::getAttributeDescriptions();
 
 	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputInfo.vertexBindingDescriptionCount = 1;
-	vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+	vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
+	vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
 	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());;
 	vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 
@@ -1145,35 +1469,22 @@ void Vulkan::createTopoPipeline(){
 	dynamicState.dynamicStateCount = 2;
 	dynamicState.pDynamicStates = dynamicStates;*/
 
-	// Push constants
+	// Object transforms
 	/**
-	 * Push constants is a way to quickly provide a small amount of uniform data to shaders. It should be much quicker
-	 * than UBOs but a huge limitation is the size of data - spec requires 128 bytes to be available for a push constant
-	 * range. Hardware vendors may support more.
-	 *
-	 * Different shader stages of a given pipeline can use the same push constant block (similarly to UBOs) or smaller
-	 * parts of the whole range. But, what is important, each shader stage can use only one push constant block. It can
-	 * contain multiple members, though. Another important thing is that the total data size (across all shader stages
-	 * which use push constants) must fit into the size constraint. So the constraint is not per stage but per whole
-	 * range.
+	 * Transforms are read from a storage buffer at the instance index of the draw instead of being pushed with it, so a
+	 * recorded command buffer stays valid while the objects move.
 	 */
-	VkPushConstantRange transformPushConst = {};
-	transformPushConst.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-	transformPushConst.size = sizeof(MeshTransforms);
-	transformPushConst.offset = 0;
-
-	std::vector<VkPushConstantRange> pushConstants = { transformPushConst };
 
 	// Pipeline layout
 
-	std::vector<VkDescriptorSetLayout> descSetLayouts = { descriptorSets[0].layout, descriptorSets[1].layout };
+	std::vector<VkDescriptorSetLayout> descSetLayouts = { descriptorSets[0].layout, descriptorSets[1].layout, descriptorSets[2].layout };
 
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
 	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	pipelineLayoutInfo.setLayoutCount = descSetLayouts.size(); // Optional
 	pipelineLayoutInfo.pSetLayouts = descSetLayouts.data();
-	pipelineLayoutInfo.pushConstantRangeCount = pushConstants.size(); // Optional
-	pipelineLayoutInfo.pPushConstantRanges = pushConstants.data(); // Optional
+	pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
+	pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
 
 	if(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayouts[0]) != VK_SUCCESS){
 		throw std::runtime_error("failed to create pipeline layout!");
@@ -1248,7 +1559,7 @@ void Vulkan::createTopoPipeline(){
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
 	pipelineInfo.basePipelineIndex = -1; // Optional
 
-	if(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipelines[0]) !=
+	if(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &graphicsPipelines[0]) !=
 	   VK_SUCCESS){
 		throw std::runtime_error("failed to create graphics pipeline!");
 	}
@@ -1266,8 +1577,8 @@ void Vulkan::createLinePipeline(){
 	 * http://www.mattikariluoma.com/blog/Segmentation%20Fault%20during%20vkCreateGraphicsPipelines.html
 	 */
 
-	auto vertShaderCode = readFile("shaders/line.vert.spv");
-	auto fragShaderCode = readFile("shaders/line.frag.spv");
+	auto vertShaderCode = getShader("line.vert");
+	auto fragShaderCode = getShader("line.frag");
 
 	VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
 	VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
@@ -1293,8 +1604,8 @@ void Vulkan::createLinePipeline(){
 	 */
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
 
-	auto bindingDescription = Vertex::getBindingDescription();
-	auto attributeDescriptions = Vertex::getAttributeDescriptions();
+	auto bindingDescription = LineVertex::getBindingDescription();
+	auto attributeDescriptions = LineVertex::getAttributeDescriptions();
 
 	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 	vertexInputInfo.vertexBindingDescriptionCount = 1;
@@ -1408,35 +1719,18 @@ void Vulkan::createLinePipeline(){
 	dynamicState.dynamicStateCount = 2;
 	dynamicState.pDynamicStates = dynamicStates;*/
 
-	// Push constants
-	/**
-	 * Push constants is a way to quickly provide a small amount of uniform data to shaders. It should be much quicker
-	 * than UBOs but a huge limitation is the size of data - spec requires 128 bytes to be available for a push constant
-	 * range. Hardware vendors may support more.
-	 *
-	 * Different shader stages of a given pipeline can use the same push constant block (similarly to UBOs) or smaller
-	 * parts of the whole range. But, what is important, each shader stage can use only one push constant block. It can
-	 * contain multiple members, though. Another important thing is that the total data size (across all shader stages
-	 * which use push constants) must fit into the size constraint. So the constraint is not per stage but per whole
-	 * range.
-	 */
-	VkPushConstantRange transformPushConst = {};
-	transformPushConst.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-	transformPushConst.size = sizeof(MeshTransforms);
-	transformPushConst.offset = 0;
-
-	std::vector<VkPushConstantRange> pushConstants = { transformPushConst };
+	// Object transforms come from the storage buffer in set 2, see createTopoPipeline
 
 	// Pipeline layout
 
-	std::vector<VkDescriptorSetLayout> descSetLayouts = { descriptorSets[0].layout, descriptorSets[1].layout };
+	std::vector<VkDescriptorSetLayout> descSetLayouts = { descriptorSets[0].layout, descriptorSets[1].layout, descriptorSets[2].layout };
 
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
 	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	pipelineLayoutInfo.setLayoutCount = descSetLayouts.size(); // Optional
 	pipelineLayoutInfo.pSetLayouts = descSetLayouts.data();
-	pipelineLayoutInfo.pushConstantRangeCount = pushConstants.size(); // Optional
-	pipelineLayoutInfo.pPushConstantRanges = pushConstants.data(); // Optional
+	pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
+	pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
 
 	if(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayouts[1]) != VK_SUCCESS){
 		throw std::runtime_error("failed to create pipeline layout!");
@@ -1511,7 +1805,7 @@ void Vulkan::createLinePipeline(){
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
 	pipelineInfo.basePipelineIndex = -1; // Optional
 
-	if(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipelines[1]) !=
+	if(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &graphicsPipelines[1]) !=
 	   VK_SUCCESS){
 		throw std::runtime_error("failed to create graphics pipeline!");
 	}
@@ -1529,8 +1823,8 @@ void Vulkan::createClothPipeline(){
 	 * http://www.mattikariluoma.com/blog/Segmentation%20Fault%20during%20vkCreateGraphicsPipelines.html
 	 */
 
-	auto vertShaderCode = readFile("shaders/topo.vert.spv");
-	auto fragShaderCode = readFile("shaders/topo.frag.spv");
+	auto vertShaderCode = getShader("topo.vert");
+	auto fragShaderCode = getShader("topo.frag");
 
 	VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
 	VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
@@ -1556,12 +1850,12 @@ void Vulkan::createClothPipeline(){
 	 */
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
 
-	auto bindingDescription = Vertex::getBindingDescription();
-	auto attributeDescriptions = Vertex::getAttributeDescriptions();
+	auto bindingDescriptions = MeshVertex::getBindingDescriptions();
+	auto attributeDescriptions = MeshVertex::getAttributeDescriptions();
 
 	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputInfo.vertexBindingDescriptionCount = 1;
-	vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+	vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
+	vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
 	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());;
 	vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 
@@ -1668,35 +1962,18 @@ void Vulkan::createClothPipeline(){
 	dynamicState.dynamicStateCount = 2;
 	dynamicState.pDynamicStates = dynamicStates;*/
 
-	// Push constants
-	/**
-	 * Push constants is a way to quickly provide a small amount of uniform data to shaders. It should be much quicker
-	 * than UBOs but a huge limitation is the size of data - spec requires 128 bytes to be available for a push constant
-	 * range. Hardware vendors may support more.
-	 *
-	 * Different shader stages of a given pipeline can use the same push constant block (similarly to UBOs) or smaller
-	 * parts of the whole range. But, what is important, each shader stage can use only one push constant block. It can
-	 * contain multiple members, though. Another important thing is that the total data size (across all shader stages
-	 * which use push constants) must fit into the size constraint. So the constraint is not per stage but per whole
-	 * range.
-	 */
-	VkPushConstantRange transformPushConst = {};
-	transformPushConst.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-	transformPushConst.size = sizeof(MeshTransforms);
-	transformPushConst.offset = 0;
-
-	std::vector<VkPushConstantRange> pushConstants = { transformPushConst };
+	// Object transforms come from the storage buffer in set 2, see createTopoPipeline
 
 	// Pipeline layout
 
-	std::vector<VkDescriptorSetLayout> descSetLayouts = { descriptorSets[0].layout, descriptorSets[1].layout };
+	std::vector<VkDescriptorSetLayout> descSetLayouts = { descriptorSets[0].layout, descriptorSets[1].layout, descriptorSets[2].layout };
 
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
 	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	pipelineLayoutInfo.setLayoutCount = descSetLayouts.size(); // Optional
 	pipelineLayoutInfo.pSetLayouts = descSetLayouts.data();
-	pipelineLayoutInfo.pushConstantRangeCount = pushConstants.size(); // Optional
-	pipelineLayoutInfo.pPushConstantRanges = pushConstants.data(); // Optional
+	pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
+	pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
 
 	if(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayouts[2]) != VK_SUCCESS){
 		throw std::runtime_error("failed to create pipeline layout!");
@@ -1771,7 +2048,7 @@ void Vulkan::createClothPipeline(){
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
 	pipelineInfo.basePipelineIndex = -1; // Optional
 
-	if(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipelines[2]) !=
+	if(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &graphicsPipelines[2]) !=
 	   VK_SUCCESS){
 		throw std::runtime_error("failed to create graphics pipeline!");
 	}
@@ -1780,11 +2057,220 @@ void Vulkan::createClothPipeline(){
 	vkDestroyShaderModule(device, vertShaderModule, nullptr);
 }
 
-VkShaderModule Vulkan::createShaderModule(const std::vector<char> &code){
+/**
+ * Compute pipeline of the mass-spring cloth solver (shaders/cloth.comp.glsl). Unlike the graphics pipelines it doesn't
+ * depend on the swap chain, so it is created once and survives swap chain recreation.
+ *
+ * Every spring system gets its own descriptor set with six storage buffers: vertices (the same buffer that is bound as
+ * the vertex buffer while drawing), mass points, springs, per-point spring lists, grid neighbours and colliders.
+ */
+void Vulkan::createComputePipeline(){
+	std::array<VkDescriptorSetLayoutBinding, CLOTH_BINDINGS> bindings = {};
+	for(uint32_t i = 0; i < CLOTH_BINDINGS; i++){
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	if(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &computeSetLayout) != VK_SUCCESS){
+		throw std::runtime_error("failed to create compute descriptor set layout!");
+	}
+
+	VkPushConstantRange paramsPushConst = {};
+	paramsPushConst.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	paramsPushConst.size = sizeof(ClothPushConstants);
+	paramsPushConst.offset = 0;
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &computeSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &paramsPushConst;
+
+	if(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &computePipelineLayout) != VK_SUCCESS){
+		throw std::runtime_error("failed to create compute pipeline layout!");
+	}
+
+	auto compShaderCode = getShader("cloth.comp");
+	VkShaderModule compShaderModule = createShaderModule(compShaderCode);
+
+	VkPipelineShaderStageCreateInfo compShaderStageInfo = {};
+	compShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	compShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	compShaderStageInfo.module = compShaderModule;
+	compShaderStageInfo.pName = "main";
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage = compShaderStageInfo;
+	pipelineInfo.layout = computePipelineLayout;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pipelineInfo.basePipelineIndex = -1;
+
+	if(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &computePipeline) != VK_SUCCESS){
+		throw std::runtime_error("failed to create compute pipeline!");
+	}
+
+	vkDestroyShaderModule(device, compShaderModule, nullptr);
+
+	// Sets are freed one by one when a spring system is deregistered
+	VkDescriptorPoolSize poolSize = {};
+	poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize.descriptorCount = CLOTH_BINDINGS * MAX_CLOTH_SYSTEMS;
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+	poolInfo.maxSets = MAX_CLOTH_SYSTEMS;
+
+	if(vkCreateDescriptorPool(device, &poolInfo, nullptr, &computeDescriptorPool) != VK_SUCCESS){
+		throw std::runtime_error("failed to create compute descriptor pool!");
+	}
+}
+
+VkDescriptorSet Vulkan::createClothDescriptorSet(const std::array<const BufferAllocation*, CLOTH_BINDINGS>& buffers){
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = computeDescriptorPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &computeSetLayout;
+
+	VkDescriptorSet set;
+	if(vkAllocateDescriptorSets(device, &allocInfo, &set) != VK_SUCCESS){
+		throw std::runtime_error("failed to allocate compute descriptor set!");
+	}
+
+	for(uint32_t i = 0; i < CLOTH_BINDINGS; i++){
+		updateClothDescriptorSet(set, i, buffers[i]);
+	}
+
+	return set;
+}
+
+void Vulkan::updateClothDescriptorSet(VkDescriptorSet set, uint32_t binding, const BufferAllocation *buffer){
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = buffer->buffer;
+	bufferInfo.offset = buffer->offset;
+	bufferInfo.range = buffer->size;
+
+	VkWriteDescriptorSet descriptorWrite = {};
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = set;
+	descriptorWrite.dstBinding = binding;
+	descriptorWrite.dstArrayElement = 0;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	descriptorWrite.descriptorCount = 1;
+	descriptorWrite.pBufferInfo = &bufferInfo;
+
+	vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+}
+
+void Vulkan::freeClothDescriptorSet(VkDescriptorSet set){
+	vkFreeDescriptorSets(device, computeDescriptorPool, 1, &set);
+}
+
+/**
+ * Starts recording the cloth solver. Waits for the previous solve, since its command buffer and the collider buffer are
+ * reused, and makes sure that the draws of previous frames are done reading the vertex buffers before they get written.
+ */
+void Vulkan::beginClothCompute(){
+	vkWaitForFences(device, 1, &computeFence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+	vkResetFences(device, 1, &computeFence);
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	if(vkBeginCommandBuffer(computeCommandBuffer, &beginInfo) != VK_SUCCESS){
+		throw std::runtime_error("failed to begin recording compute command buffer!");
+	}
+
+	// Write-after-read, an execution dependency is enough
+	vkCmdPipelineBarrier(computeCommandBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+						 0, 0, nullptr, 0, nullptr, 0, nullptr);
+}
+
+/**
+ * Records all physics steps of one spring system. Every step is two dispatches (forces, then integration) because the
+ * integration of a point must not start before all of its neighbours have read its old position. Normals are computed
+ * once at the end.
+ */
+void Vulkan::dispatchCloth(VkDescriptorSet set, ClothPushConstants params, int steps){
+	vkCmdBindPipeline(computeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
+	vkCmdBindDescriptorSets(computeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout, 0, 1, &set, 0, nullptr);
+
+	uint32_t groups = (params.noPoints + CLOTH_GROUP_SIZE - 1) / CLOTH_GROUP_SIZE;
+
+	for(int step = 0; step < steps; step++){
+		params.colliderOffset = step * params.colliderCount;
+
+		for(uint32_t stage = 0; stage < 2; stage++){
+			params.stage = stage;
+			vkCmdPushConstants(computeCommandBuffer, computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ClothPushConstants), &params);
+			vkCmdDispatch(computeCommandBuffer, groups, 1, 1);
+			computeBarrier();
+		}
+	}
+
+	params.stage = 2;
+	vkCmdPushConstants(computeCommandBuffer, computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ClothPushConstants), &params);
+	vkCmdDispatch(computeCommandBuffer, groups, 1, 1);
+	computeBarrier();
+}
+
+void Vulkan::computeBarrier(){
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(computeCommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+						 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+/**
+ * Submits the solver on the graphics queue. The draw command buffer is submitted after it on the same queue, so the
+ * barrier at the end is enough to make the new positions visible to the vertex input stage (and to transfers, used
+ * when reading the cloth back).
+ */
+void Vulkan::endClothCompute(){
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+
+	vkCmdPipelineBarrier(computeCommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+						 VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+						 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	if(vkEndCommandBuffer(computeCommandBuffer) != VK_SUCCESS){
+		throw std::runtime_error("failed to record compute command buffer!");
+	}
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &computeCommandBuffer;
+
+	if(vkQueueSubmit(graphicsQueue, 1, &submitInfo, computeFence) != VK_SUCCESS){
+		throw std::runtime_error("failed to submit compute command buffer!");
+	}
+}
+
+VkShaderModule Vulkan::createShaderModule(const ShaderCode &code){
 	VkShaderModuleCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.codeSize = code.size();
-	createInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
+	createInfo.codeSize = code.size;
+	createInfo.pCode = reinterpret_cast<const uint32_t *>(code.data);
 
 	VkShaderModule shaderModule;
 	if(vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS){
@@ -1845,6 +2331,26 @@ void Vulkan::createCommandPool(){
 	if(vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS){
 		throw std::runtime_error("failed to create command pool!");
 	}
+
+	if(transferQueue != VK_NULL_HANDLE){
+		VkCommandPoolCreateInfo transferPoolInfo = poolInfo;
+		transferPoolInfo.queueFamilyIndex = transferFamily;
+
+		if(vkCreateCommandPool(device, &transferPoolInfo, nullptr, &transferPool) != VK_SUCCESS){
+			throw std::runtime_error("failed to create transfer command pool!");
+		}
+	}
+
+	// Command pools can't be used from two threads at once, every draw chunk gets its own
+	ThreadPool* pool = PhysicsEngine::threadPool;
+	unsigned chunks = drawThreads > 0 ? drawThreads : (pool != nullptr ? pool->size() : 1);
+
+	drawPools.resize(chunks > 1 ? chunks : 0);
+	for(VkCommandPool& drawPool : drawPools){
+		if(vkCreateCommandPool(device, &poolInfo, nullptr, &drawPool) != VK_SUCCESS){
+			throw std::runtime_error("failed to create command pool!");
+		}
+	}
 }
 
 /**
@@ -1857,9 +2363,9 @@ void Vulkan::createCommandPool(){
  * @param usage
  * @param properties
  * @param image
- * @param imageMemory
+ * @param imageAllocation
  */
-void Vulkan::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory) {
+void Vulkan::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VmaAllocation& imageAllocation) {
 	VkImageCreateInfo imageInfo = {};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 	imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -1875,23 +2381,16 @@ void Vulkan::createImage(uint32_t width, uint32_t height, VkFormat format, VkIma
 	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
 	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-	if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create image!");
+	// Attachments are recreated with the swap chain, they get memory of their own instead of a part of a block
+	VmaAllocationCreateInfo allocInfo = {};
+	allocInfo.requiredFlags = properties;
+	if(usage & (VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)){
+		allocInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
 	}
 
-	VkMemoryRequirements memRequirements;
-	vkGetImageMemoryRequirements(device, image, &memRequirements);
-
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-	if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate image memory!");
+	if (vmaCreateImage(allocator, &imageInfo, &allocInfo, &image, &imageAllocation, nullptr) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create image!");
 	}
-
-	vkBindImageMemory(device, image, imageMemory, 0);
 }
 
 /**
@@ -2066,7 +2565,7 @@ void Vulkan::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, u
  */
 void Vulkan::createDepthResources(){
 	VkFormat depthFormat = findDepthFormat();
-	createImage(swapChainExtent.width, swapChainExtent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory);
+	createImage(swapChainExtent.width, swapChainExtent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageAllocation);
 	depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
 
 	transitionImageLayout(depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
@@ -2120,7 +2619,7 @@ VkFormat Vulkan::findSupportedFormat(const std::vector<VkFormat>& candidates, Vk
 
 
 void Vulkan::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
-											VkBuffer& buffer, VkDeviceMemory& bufferMemory){
+											VkBuffer& buffer, VmaAllocation& allocation, VmaPool pool){
 	VkBufferCreateInfo bufferInfo = {};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	bufferInfo.size = size; // the size of the buffer in bytes
@@ -2139,47 +2638,30 @@ void Vulkan::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryP
 	 */
 	bufferInfo.flags = 0;
 
-	if(vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS){
-		throw std::runtime_error("failed to create vertex buffer!");
-	}
-
 	/**
 	 * Allocate memory for buffer
 	 *
-	 * The VkMemoryRequirements struct has three fields:
-	 * - size: The size of the required amount of memory in bytes, may differ from bufferInfo.size.
-	 * - alignment: The offset in bytes where the buffer begins in the allocated region of memory, depends on bufferInfo.usage and bufferInfo.flags.
-	 * - memoryTypeBits: Bit field of the memory types that are suitable for the buffer.
-	 */
-	VkMemoryRequirements memRequirements;
-	vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
-
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-
-	/**
-	 * The properties define special features of
-	 * the memory, like being able to map it so we can write to it from the CPU. This property is indicated with
-	 * VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, but we also need to use the VK_MEMORY_PROPERTY_HOST_COHERENT_BIT property.
+	 * The properties define special features of the memory, like being able to map it so we can write to it from
+	 * the CPU. This property is indicated with VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, but we also need to use the
+	 * VK_MEMORY_PROPERTY_HOST_COHERENT_BIT property.
+	 *
+	 * The allocator places the buffer in one of its blocks at an offset that satisfies the memory requirements and
+	 * binds it. A pool already has its memory type, the properties only pick one for the default pools.
 	 */
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+	VmaAllocationCreateInfo allocInfo = {};
+	allocInfo.requiredFlags = properties;
+	allocInfo.pool = pool;
 
-	if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate vertex buffer memory!");
+	if(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &buffer, &allocation, nullptr) != VK_SUCCESS){
+		throw std::runtime_error("failed to create buffer!");
 	}
-
-	/**
-	 * Associate the memory with the buffer
-	 *
-	 * The first three parameters are self-explanatory and the fourth parameter is the offset within the region of
-	 * memory. Since this memory is allocated specifically for this the vertex buffer, the offset is simply 0. If
-	 * the offset is non-zero, then it is required to be divisible by memRequirements.alignment.
-	 */
-	vkBindBufferMemory(device, buffer, bufferMemory, 0);
 }
 
 void Vulkan::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize offset, VkDeviceSize size){
+	copyBuffer(srcBuffer, dstBuffer, 0, offset, size);
+}
+
+void Vulkan::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize srcOffset, VkDeviceSize dstOffset, VkDeviceSize size){
 	/**
 	 * Memory transfer operations are executed using command buffers, just like drawing commands. Therefore we must
 	 * first allocate a temporary command buffer.
@@ -2188,8 +2670,8 @@ void Vulkan::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize off
 
 	// Copy:
 	VkBufferCopy copyRegion = {};
-	copyRegion.srcOffset = 0; // Optional
-	copyRegion.dstOffset = offset; // Optional
+	copyRegion.srcOffset = srcOffset; // Optional
+	copyRegion.dstOffset = dstOffset; // Optional
 	copyRegion.size = size;
 	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
@@ -2256,6 +2738,310 @@ void Vulkan::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
 	vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
 }
 
+/**
+ * That is what the transfer batches do: uploads are only recorded, everything queued for a frame or while loading a
+ * scene is submitted at once and waited for with a fence, only when the batch is needed again.
+ */
+void Vulkan::createTransferBatches(){
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = 1;
+
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	for(TransferBatch& batch : transferBatches){
+		allocInfo.commandPool = transferQueue != VK_NULL_HANDLE ? transferPool : commandPool;
+
+		if(vkAllocateCommandBuffers(device, &allocInfo, &batch.commandBuffer) != VK_SUCCESS){
+			throw std::runtime_error("failed to allocate transfer command buffers!");
+		}
+
+		if(vkCreateFence(device, &fenceInfo, nullptr, &batch.fence) != VK_SUCCESS){
+			throw std::runtime_error("failed to create transfer fence!");
+		}
+
+		if(transferQueue != VK_NULL_HANDLE){
+			allocInfo.commandPool = commandPool;
+
+			if(vkAllocateCommandBuffers(device, &allocInfo, &batch.acquireBuffer) != VK_SUCCESS
+			   || vkCreateSemaphore(device, &semaphoreInfo, nullptr, &batch.semaphore) != VK_SUCCESS){
+				throw std::runtime_error("failed to create transfer synchronization!");
+			}
+		}
+
+		createStaging(batch, TRANSFER_STAGING_SIZE);
+	}
+
+	if(transferQueue != VK_NULL_HANDLE){
+		drawSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+
+		for(VkSemaphore& semaphore : drawSemaphores){
+			if(vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS){
+				throw std::runtime_error("failed to create transfer synchronization!");
+			}
+		}
+	}
+}
+
+void Vulkan::destroyTransferBatches(){
+	flushUploads();
+
+	for(TransferBatch& batch : transferBatches){
+		vkWaitForFences(device, 1, &batch.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+
+		destroyStaging(batch);
+		vkDestroyFence(device, batch.fence, nullptr);
+
+		if(transferQueue != VK_NULL_HANDLE){
+			vkFreeCommandBuffers(device, transferPool, 1, &batch.commandBuffer);
+			vkFreeCommandBuffers(device, commandPool, 1, &batch.acquireBuffer);
+			vkDestroySemaphore(device, batch.semaphore, nullptr);
+		}else{
+			vkFreeCommandBuffers(device, commandPool, 1, &batch.commandBuffer);
+		}
+	}
+
+	for(VkSemaphore semaphore : drawSemaphores){
+		vkDestroySemaphore(device, semaphore, nullptr);
+	}
+}
+
+void Vulkan::createStaging(TransferBatch &batch, VkDeviceSize capacity){
+	createBuffer(capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				 batch.staging, batch.stagingAllocation, getPool(MemoryPool::STAGING));
+
+	vmaMapMemory(allocator, batch.stagingAllocation, (void**) &batch.stagingData);
+	batch.capacity = capacity;
+}
+
+void Vulkan::destroyStaging(TransferBatch &batch){
+	vmaUnmapMemory(allocator, batch.stagingAllocation);
+	vmaDestroyBuffer(allocator, batch.staging, batch.stagingAllocation);
+}
+
+/**
+ * Copies the data into staging memory and records the copy into the current batch, starting a new batch when it is
+ * full. The copy happens once the batch is flushed, the data can be freed right away.
+ */
+void Vulkan::queueUpload(VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size, const void *data){
+	TransferBatch* batch = &transferBatches[transferBatch];
+
+	if(batch->recording && batch->used + size > batch->capacity){
+		flushUploads();
+		batch = &transferBatches[transferBatch];
+	}
+
+	if(!batch->recording){
+		beginTransferBatch(*batch, size);
+	}
+
+	memcpy(batch->stagingData + batch->used, data, (size_t) size);
+
+	VkBufferCopy copyRegion = {};
+	copyRegion.srcOffset = batch->used;
+	copyRegion.dstOffset = dstOffset;
+	copyRegion.size = size;
+	vkCmdCopyBuffer(batch->commandBuffer, batch->staging, dstBuffer, 1, &copyRegion);
+
+	batch->used += size;
+
+	// Released to the graphics family when the batch is flushed, only the written range since the rest of the buffer
+	// stays with the graphics queue
+	if(transferQueue != VK_NULL_HANDLE && transferFamily != graphicsFamily){
+		VkBufferMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.srcQueueFamilyIndex = transferFamily;
+		barrier.dstQueueFamilyIndex = graphicsFamily;
+		barrier.buffer = dstBuffer;
+		barrier.offset = dstOffset;
+		barrier.size = size;
+
+		batch->ownership.push_back(barrier);
+	}
+}
+
+void Vulkan::beginTransferBatch(TransferBatch &batch, VkDeviceSize size){
+	// The copies last submitted from this batch still read its staging memory
+	vkWaitForFences(device, 1, &batch.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+
+	if(size > batch.capacity){
+		destroyStaging(batch);
+		createStaging(batch, std::max(size, 2 * batch.capacity));
+	}
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	if(vkBeginCommandBuffer(batch.commandBuffer, &beginInfo) != VK_SUCCESS){
+		throw std::runtime_error("failed to begin recording transfer command buffer!");
+	}
+
+	// Earlier frames may still draw, simulate or copy from and into the buffers that get written. On a transfer queue
+	// only earlier copies can, the frames are waited for with a semaphore.
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+
+	if(transferQueue != VK_NULL_HANDLE){
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+		vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+							 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}else{
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+		vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+							 VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	batch.used = 0;
+	batch.recording = true;
+}
+
+/**
+ * Submits the current batch, if anything was queued, and moves on to the next one. Everything submitted after it on
+ * the graphics queue sees the uploaded data.
+ */
+void Vulkan::flushUploads(){
+	TransferBatch& batch = transferBatches[transferBatch];
+	if(!batch.recording) return;
+
+	if(transferQueue != VK_NULL_HANDLE){
+		submitTransferQueue(batch);
+
+		batch.recording = false;
+		transferBatch = (transferBatch + 1) % TRANSFER_BATCHES;
+		return;
+	}
+
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT
+							| VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+						 VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+						 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	if(vkEndCommandBuffer(batch.commandBuffer) != VK_SUCCESS){
+		throw std::runtime_error("failed to record transfer command buffer!");
+	}
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch.commandBuffer;
+
+	vkResetFences(device, 1, &batch.fence);
+
+	if(vkQueueSubmit(graphicsQueue, 1, &submitInfo, batch.fence) != VK_SUCCESS){
+		throw std::runtime_error("failed to submit transfer command buffer!");
+	}
+
+	batch.recording = false;
+	transferBatch = (transferBatch + 1) % TRANSFER_BATCHES;
+}
+
+/**
+ * Submits the copies of a batch on the transfer queue, after the last frame stopped reading the vertices, and their
+ * acquire on the graphics queue. The batch's fence is signaled by the acquire, which is done after the copies. A
+ * semaphore wait only orders its own submit, so the acquire always records a barrier that carries the copies over to
+ * the draw and compute submits after it.
+ */
+void Vulkan::submitTransferQueue(TransferBatch &batch){
+	const VkPipelineStageFlags consumerStages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+	if(!batch.ownership.empty()){
+		vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+							 0, nullptr, static_cast<uint32_t>(batch.ownership.size()), batch.ownership.data(), 0, nullptr);
+	}
+
+	if(vkEndCommandBuffer(batch.commandBuffer) != VK_SUCCESS){
+		throw std::runtime_error("failed to record transfer command buffer!");
+	}
+
+	VkPipelineStageFlags transferStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch.commandBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &batch.semaphore;
+
+	if(pendingDrawSemaphore != VK_NULL_HANDLE){
+		submitInfo.waitSemaphoreCount = 1;
+		submitInfo.pWaitSemaphores = &pendingDrawSemaphore;
+		submitInfo.pWaitDstStageMask = &transferStage;
+	}
+
+	if(vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS){
+		throw std::runtime_error("failed to submit transfer command buffer!");
+	}
+
+	pendingDrawSemaphore = VK_NULL_HANDLE;
+
+	// Acquire, the access masks of a release are ignored on the other queue
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	if(vkBeginCommandBuffer(batch.acquireBuffer, &beginInfo) != VK_SUCCESS){
+		throw std::runtime_error("failed to begin recording acquire command buffer!");
+	}
+
+	const VkAccessFlags consumerAccess = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT
+										 | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+
+	// The source stages chain with the semaphore wait below
+	if(!batch.ownership.empty()){
+		for(VkBufferMemoryBarrier& barrier : batch.ownership){
+			barrier.dstAccessMask = consumerAccess;
+		}
+
+		vkCmdPipelineBarrier(batch.acquireBuffer, consumerStages, consumerStages, 0,
+							 0, nullptr, static_cast<uint32_t>(batch.ownership.size()), batch.ownership.data(), 0, nullptr);
+		batch.ownership.clear();
+	}else{
+		// Same queue family, nothing changes owner
+		VkMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = consumerAccess;
+
+		vkCmdPipelineBarrier(batch.acquireBuffer, consumerStages, consumerStages, 0,
+							 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	if(vkEndCommandBuffer(batch.acquireBuffer) != VK_SUCCESS){
+		throw std::runtime_error("failed to record acquire command buffer!");
+	}
+
+	submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch.acquireBuffer;
+	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.pWaitSemaphores = &batch.semaphore;
+	submitInfo.pWaitDstStageMask = &consumerStages;
+
+	vkResetFences(device, 1, &batch.fence);
+
+	if(vkQueueSubmit(graphicsQueue, 1, &submitInfo, batch.fence) != VK_SUCCESS){
+		throw std::runtime_error("failed to submit acquire command buffer!");
+	}
+}
+
 /**
  *Graphics cards can offer different types of memory to allocate from. Each type of memory varies in terms of allowed
  * operations and performance characteristics. We need to combine the requirements of the buffer and our own
@@ -2293,33 +3079,97 @@ uint32_t Vulkan::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags prope
 	throw std::runtime_error("failed to find suitable memory type!");
 }
 
+/**
+ * Creates the uniform ring, see UniformRing. A slice fits the camera, lights and transforms of a frame with every
+ * allocation aligned for both uniform and storage descriptors, plus UNIFORM_SLICE_RESERVE.
+ */
 void Vulkan::createUniformBuffers(){
-	uniformBuffers.resize(2);
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	VkDeviceSize alignment = std::max(properties.limits.minUniformBufferOffsetAlignment,
+									  properties.limits.minStorageBufferOffsetAlignment);
+	auto aligned = [alignment](VkDeviceSize size){ return (size + alignment - 1) / alignment * alignment; };
+
+	transformCapacity = std::max(transformCapacity, Storage::transforms.size());
+
+	uniformRing.alignment = alignment;
+	uniformRing.sliceSize = aligned(sizeof(UBOViewProj)) + aligned(sizeof(UBOLights)) +
+							aligned(transformCapacity * sizeof(MeshTransforms)) + aligned(UNIFORM_SLICE_RESERVE);
+
+	createBuffer(uniformRing.sliceSize * swapChainImages.size(), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				 uniformRing.buffer, uniformRing.allocation);
+
+	vmaMapMemory(allocator, uniformRing.allocation, (void**) &uniformRing.data);
+
+	// Offsets nothing allocates at, so every image records its command buffer after its first allocations
+	uniformOffsets.assign(swapChainImages.size(), { UINT32_MAX, UINT32_MAX, UINT32_MAX });
+}
 
-	uniformBuffers[0].buffer.resize(swapChainImages.size());
-	uniformBuffers[1].buffer.resize(swapChainImages.size());
+void Vulkan::destroyUniformBuffers(){
+	vmaUnmapMemory(allocator, uniformRing.allocation);
+	vmaDestroyBuffer(allocator, uniformRing.buffer, uniformRing.allocation);
 
-	uniformBuffers[0].memory.resize(swapChainImages.size());
-	uniformBuffers[1].memory.resize(swapChainImages.size());
+	uniformRing = UniformRing();
+}
+
+/**
+ * Indirect draw commands, one buffer per swap chain image so an image's commands can be rewritten while another image
+ * is drawn. Next to them the transform slots of the instances, at most one per object. They stay mapped.
+ */
+void Vulkan::createIndirectBuffers(){
+	indirectBuffers.buffer.resize(swapChainImages.size());
+	indirectBuffers.allocation.resize(swapChainImages.size());
+	indirectCommands.resize(swapChainImages.size());
+
+	instanceBuffers.buffer.resize(swapChainImages.size());
+	instanceBuffers.allocation.resize(swapChainImages.size());
+	instanceSlots.resize(swapChainImages.size());
+
+	indirectCapacity = std::max(indirectCapacity, (size_t) Storage::renderObjects.size());
 
 	for(size_t i = 0; i < swapChainImages.size(); i++){
-		createBuffer(sizeof(UBOViewProj), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+		createBuffer(indirectCapacity * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
 					 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-					 uniformBuffers[0].buffer[i], uniformBuffers[0].memory[i]);
+					 indirectBuffers.buffer[i], indirectBuffers.allocation[i]);
 
-		createBuffer(sizeof(UBOLights), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+		vmaMapMemory(allocator, indirectBuffers.allocation[i], (void**) &indirectCommands[i]);
+
+		createBuffer(indirectCapacity * sizeof(uint32_t), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
 					 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-					 uniformBuffers[1].buffer[i], uniformBuffers[1].memory[i]);
+					 instanceBuffers.buffer[i], instanceBuffers.allocation[i]);
+
+		vmaMapMemory(allocator, instanceBuffers.allocation[i], (void**) &instanceSlots[i]);
 	}
 }
 
+void Vulkan::growIndirectBuffers(size_t capacity){
+	vkDeviceWaitIdle(device);
+
+	for(size_t i = 0; i < swapChainImages.size(); i++){
+		vmaUnmapMemory(allocator, indirectBuffers.allocation[i]);
+		vmaDestroyBuffer(allocator, indirectBuffers.buffer[i], indirectBuffers.allocation[i]);
+
+		vmaUnmapMemory(allocator, instanceBuffers.allocation[i]);
+		vmaDestroyBuffer(allocator, instanceBuffers.buffer[i], instanceBuffers.allocation[i]);
+	}
+
+	indirectCapacity = capacity;
+	createIndirectBuffers();
+
+	invalidateCommandBuffers();
+}
+
 /**
  * https://vulkan-tutorial.com/Uniform_buffers/Descriptor_pool_and_sets
  */
 void Vulkan::createDescriptorPool(){
-	std::array<VkDescriptorPoolSize, 1> poolSizes = {};
-	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSizes[0].descriptorCount = static_cast<uint32_t>(2 * swapChainImages.size()); // TODO: descriptor count
+	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	poolSizes[0].descriptorCount = 2;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	poolSizes[1].descriptorCount = 1;
 
 
 	VkDescriptorPoolCreateInfo poolInfo = {};
@@ -2327,7 +3177,8 @@ void Vulkan::createDescriptorPool(){
 	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());;
 	poolInfo.pPoolSizes = poolSizes.data();
 
-	poolInfo.maxSets = static_cast<uint32_t>(2 * swapChainImages.size());
+	// The sets are shared by all images, which bind them at the offsets of their slice of the uniform ring
+	poolInfo.maxSets = 3;
 
 	if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create descriptor pool!");
@@ -2335,45 +3186,56 @@ void Vulkan::createDescriptorPool(){
 }
 
 void Vulkan::createDescriptorSets(){
-	descriptorSets[0].set.resize(swapChainImages.size());
-	descriptorSets[1].set.resize(swapChainImages.size());
-
-	createBufferDescriptorSet(descriptorSets[0].layout, descriptorSets[0].set.data(), uniformBuffers[0], sizeof(UBOViewProj));
-	createBufferDescriptorSet(descriptorSets[1].layout, descriptorSets[1].set.data(), uniformBuffers[1], sizeof(UBOLights));
-	//createImageDescriptorSet(descriptorSets[2].layout, descriptorSets[2].set, textureImageView, textureSampler);
-}
+	std::array<VkDescriptorSetLayout, 3> layouts = { descriptorSets[0].layout, descriptorSets[1].layout, descriptorSets[2].layout };
+	std::array<VkDescriptorSet, 3> sets;
 
-void Vulkan::createBufferDescriptorSet(VkDescriptorSetLayout layout, VkDescriptorSet *pos, UniformBuffer buffer, VkDeviceSize bufferSize){
-	std::vector<VkDescriptorSetLayout> layouts(swapChainImages.size(), layout);
 	VkDescriptorSetAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	allocInfo.descriptorPool = descriptorPool;
-	allocInfo.descriptorSetCount = static_cast<uint32_t>(swapChainImages.size());
+	allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
 	allocInfo.pSetLayouts = layouts.data();
 
-	if (vkAllocateDescriptorSets(device, &allocInfo, pos) != VK_SUCCESS) {
+	if (vkAllocateDescriptorSets(device, &allocInfo, sets.data()) != VK_SUCCESS) {
 		throw std::runtime_error("failed to allocate descriptor sets!");
 	}
 
-	for (size_t i = 0; i < swapChainImages.size(); i++) {
-		VkDescriptorBufferInfo bufferInfo = {};
-		bufferInfo.buffer = buffer.buffer[i];
-		bufferInfo.offset = 0;
-		bufferInfo.range = bufferSize;
+	for(size_t i = 0; i < sets.size(); i++){
+		descriptorSets[i].set = sets[i];
+	}
+
+	writeUniformDescriptors();
+	//createImageDescriptorSet(descriptorSets[2].layout, descriptorSets[2].set, textureImageView, textureSampler);
+}
 
-		VkWriteDescriptorSet descriptorWrite = {};
-		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrite.dstSet = pos[i];
-		descriptorWrite.dstBinding = 0;
-		descriptorWrite.dstArrayElement = 0;
-		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptorWrite.descriptorCount = 1;
-		descriptorWrite.pBufferInfo = &bufferInfo;
-		descriptorWrite.pImageInfo = nullptr; // Optional
-		descriptorWrite.pTexelBufferView = nullptr; // Optional
+/**
+ * Points the sets at the uniform ring. The ranges are the sizes of single allocations, the dynamic offsets select the
+ * allocation.
+ */
+void Vulkan::writeUniformDescriptors(){
+	writeBufferDescriptor(descriptorSets[0].set, uniformRing.buffer, sizeof(UBOViewProj), VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
+	writeBufferDescriptor(descriptorSets[1].set, uniformRing.buffer, sizeof(UBOLights), VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
+	writeBufferDescriptor(descriptorSets[2].set, uniformRing.buffer, transformCapacity * sizeof(MeshTransforms),
+						  VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC);
+}
 
-		vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
-	}
+void Vulkan::writeBufferDescriptor(VkDescriptorSet set, VkBuffer buffer, VkDeviceSize bufferSize, VkDescriptorType descriptorType){
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = buffer;
+	bufferInfo.offset = 0;
+	bufferInfo.range = bufferSize;
+
+	VkWriteDescriptorSet descriptorWrite = {};
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = set;
+	descriptorWrite.dstBinding = 0;
+	descriptorWrite.dstArrayElement = 0;
+	descriptorWrite.descriptorType = descriptorType;
+	descriptorWrite.descriptorCount = 1;
+	descriptorWrite.pBufferInfo = &bufferInfo;
+	descriptorWrite.pImageInfo = nullptr; // Optional
+	descriptorWrite.pTexelBufferView = nullptr; // Optional
+
+	vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
 }
 
 /**
@@ -2417,9 +3279,41 @@ void Vulkan::createCommandBuffers(){
 		throw std::runtime_error("failed to allocate command buffers!");
 	}
 
-	for(size_t i = 0; i < commandBuffers.size(); i++){
-		//recordCommandBuffer(i);
+	secondaryBuffers.resize(drawPools.size());
+
+	for(size_t c = 0; c < drawPools.size(); c++){
+		secondaryBuffers[c].resize(commandBuffers.size());
+
+		VkCommandBufferAllocateInfo secondaryInfo = {};
+		secondaryInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		secondaryInfo.commandPool = drawPools[c];
+		secondaryInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		secondaryInfo.commandBufferCount = (uint32_t) secondaryBuffers[c].size();
+
+		if(vkAllocateCommandBuffers(device, &secondaryInfo, secondaryBuffers[c].data()) != VK_SUCCESS){
+			throw std::runtime_error("failed to allocate secondary command buffers!");
+		}
 	}
+
+	// Recorded before their first use
+	commandBufferDirty.assign(commandBuffers.size(), true);
+	imagesInFlight.assign(commandBuffers.size(), VK_NULL_HANDLE);
+}
+
+VkDeviceSize Vulkan::getStorageAlignment() const{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	return properties.limits.minStorageBufferOffsetAlignment;
+}
+
+/**
+ * Has every command buffer recorded again before its next use. Needed whenever the set of render objects, their
+ * pipelines or buffers change, or the springs are turned on or off. Transforms are read from the transform buffer and
+ * don't need this.
+ */
+void Vulkan::invalidateCommandBuffers(){
+	std::fill(commandBufferDirty.begin(), commandBufferDirty.end(), true);
 }
 
 void Vulkan::recordCommandBuffer(size_t i){
@@ -2474,81 +3368,202 @@ void Vulkan::recordCommandBuffer(size_t i){
 	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
 	renderPassInfo.pClearValues = clearValues.data();
 
-	// Begin render pass
-	vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	// Objects sharing a pipeline and geometry buffers next to each other, within them objects sharing one mesh
+	drawOrder.assign(Storage::renderObjects.begin(), Storage::renderObjects.end());
 
-	// Bind pipeline
-	/**
-	 * The second parameter specifies if the pipeline object is a graphics or compute pipeline.
-	 */
-	vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelines[0]);
+	std::sort(drawOrder.begin(), drawOrder.end(), [](const RenderComponent* a, const RenderComponent* b){
+		return std::make_tuple(a->pipeline, a->vertexBuffer->buffer, a->indexBuffer->buffer, a->indexType, a->vertexBuffer->offset)
+			 < std::make_tuple(b->pipeline, b->vertexBuffer->buffer, b->indexBuffer->buffer, b->indexType, b->vertexBuffer->offset);
+	});
 
-	// Bind descriptorsstd::vector<VkDescriptorSet> cmdDescriptorSets = { descriptorSets[0].set[i], descriptorSets[1].set[i] };
-	std::vector<VkDescriptorSet> cmdDescriptorSets = { descriptorSets[0].set[i], descriptorSets[1].set[i] };
-	vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts[0], 0, cmdDescriptorSets.size(), cmdDescriptorSets.data(), 0, nullptr);
-	vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts[1], 0, cmdDescriptorSets.size(), cmdDescriptorSets.data(), 0, nullptr);
-	vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts[2], 0, cmdDescriptorSets.size(), cmdDescriptorSets.data(), 0, nullptr);
+	if(drawOrder.size() > indirectCapacity){
+		growIndirectBuffers(std::max(drawOrder.size(), 2 * indirectCapacity));
+	}
+
+	// Begin render pass, the draws are either recorded inline or executed from the secondary buffers of the workers
+	bool secondary = secondaryBuffers.size() > 1;
+	vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, secondary ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+
+	size_t objectCount = drawOrder.size();
+	drawSprings.clear();
+	if(drawMesh) drawSprings.assign(Storage::springs.begin(), Storage::springs.end());
+
+	size_t springCount = drawSprings.size();
+
+	if(secondary){
+		size_t chunks = secondaryBuffers.size();
+
+		// Every chunk records into the buffer of its own command pool, so no pool is used by two threads at once
+		auto recordChunks = [&](size_t begin, size_t end){
+			for(size_t c = begin; c < end; c++){
+				recordSecondary(c, i, objectCount * c / chunks, objectCount * (c + 1) / chunks,
+								springCount * c / chunks, springCount * (c + 1) / chunks);
+			}
+		};
+
+		ThreadPool* pool = PhysicsEngine::threadPool;
+		if(pool != nullptr) pool->parallelFor(chunks, 1, recordChunks);
+		else recordChunks(0, chunks);
+
+		std::vector<VkCommandBuffer> executed(chunks);
+		for(size_t c = 0; c < chunks; c++){
+			executed[c] = secondaryBuffers[c][i];
+		}
+
+		vkCmdExecuteCommands(commandBuffers[i], executed.size(), executed.data());
+	}else{
+		recordDraws(commandBuffers[i], i, 0, objectCount, 0, springCount);
+	}
+
+	// End render pass
+	vkCmdEndRenderPass(commandBuffers[i]);
+
+	// Finish recording the command buffer:
+	if(vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS){
+		throw std::runtime_error("failed to record command buffer!");
+	}
+}
+
+/**
+ * Records the draws of one chunk of the render objects and springs into its secondary command buffer. Runs on a worker
+ * thread, the buffer comes from the chunk's own command pool.
+ */
+void Vulkan::recordSecondary(size_t chunk, size_t i, size_t objectsBegin, size_t objectsEnd, size_t springsBegin, size_t springsEnd){
+	VkCommandBuffer commandBuffer = secondaryBuffers[chunk][i];
 
-	// Draw command
 	/**
-	 *  vertexCount: Number of vertices (from the vertex buffer)
-	 *  instanceCount: Used for instanced rendering, use 1 if you're not doing that.
-	 *  firstVertex: Used as an offset into the vertex buffer, defines the lowest value of gl_VertexIndex.
-	 *  firstInstance: Used as an offset for instanced rendering, defines the lowest value of gl_InstanceIndex
+	 * Secondary command buffers that run inside a render pass have to name it, along with the subpass and (optionally)
+	 * the framebuffer they will be executed in.
 	 */
-	//vkCmdDraw(commandBuffers[i], static_cast<uint32_t>(vertices.size()), 1, 0, 0);
+	VkCommandBufferInheritanceInfo inheritanceInfo = {};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = renderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = swapChainFramebuffers[i];
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+	beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+	if(vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS){
+		throw std::runtime_error("failed to begin recording secondary command buffer!");
+	}
+
+	recordDraws(commandBuffer, i, objectsBegin, objectsEnd, springsBegin, springsEnd);
+
+	if(vkEndCommandBuffer(commandBuffer) != VK_SUCCESS){
+		throw std::runtime_error("failed to record secondary command buffer!");
+	}
+}
+
+/**
+ * Binds the descriptor sets of image i and records the draws of a range of drawOrder and of the springs. Nothing is
+ * inherited by secondary command buffers, so every one of them starts by binding the sets again.
+ */
+void Vulkan::recordDraws(VkCommandBuffer commandBuffer, size_t i, size_t objectsBegin, size_t objectsEnd, size_t springsBegin, size_t springsEnd){
+	// Bind descriptors, the pipeline layouts are identical so the sets stay bound when the pipeline changes. The
+	// dynamic offsets select the image's slice of the uniform ring.
+	std::vector<VkDescriptorSet> cmdDescriptorSets = { descriptorSets[0].set, descriptorSets[1].set, descriptorSets[2].set };
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts[0], 0, cmdDescriptorSets.size(), cmdDescriptorSets.data(),
+							uniformOffsets[i].size(), uniformOffsets[i].data());
 
+	// Draw command
 	/**
-	 * Just binding an index buffer doesn't change anything yet, we also need to change the drawing command to tell
-	 * Vulkan to use the index buffer. Remove the vkCmdDraw line and replace it with vkCmdDrawIndexed:
+	 * Objects with the same geometry are one command of the indirect buffer, drawn instanced:
+	 *
+	 * indexCount, instanceCount: the number of objects
+	 * firstIndex: offset into the index buffer, the mesh's indices in the shared geometry buffer
+	 * vertexOffset: offset to add to the indices in the index buffer, the mesh's first vertex
+	 * firstInstance: offset for instancing, the first of the objects' transform slots in the instance buffer
 	 *
-	 * indexCount, instanceCount
-	 * firstIndex: offset into the index buffer
-	 * vertexOffset: offset to add to the indices in the index buffer
-	 * firstInstance: offset for instancing
+	 * The instance buffer is indexed like drawOrder, so a range never writes outside its own part of either buffer.
 	 */
-	//vkCmdDrawIndexed(commandBuffers[i], static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
-	for(int j = 0; j < Storage::renderObjects.size(); ++j){
-		RenderComponent *rObj = Storage::renderObjects[j];
+	VkDrawIndexedIndirectCommand* commands = indirectCommands[i];
+	uint32_t* instances = instanceSlots[i];
+	const VkDeviceSize stride = sizeof(VkDrawIndexedIndirectCommand);
+
+	size_t command = objectsBegin;
+	size_t j = objectsBegin;
+	while(j < objectsEnd){
+		RenderComponent* first = drawOrder[j];
+		size_t run = j;
+		size_t runCommand = command;
+
+		while(run < objectsEnd){
+			RenderComponent* rObj = drawOrder[run];
+
+			if(rObj->pipeline != first->pipeline || rObj->vertexBuffer->buffer != first->vertexBuffer->buffer
+			   || rObj->indexBuffer->buffer != first->indexBuffer->buffer || rObj->indexType != first->indexType) break;
+
+			VkDeviceSize indexSize = rObj->indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+
+			commands[command].indexCount = static_cast<uint32_t>(rObj->getMesh().indices.size());
+			commands[command].instanceCount = 0;
+			commands[command].firstIndex = static_cast<uint32_t>(rObj->indexBuffer->offset / indexSize);
+			commands[command].vertexOffset = static_cast<int32_t>(rObj->vertexBuffer->offset / sizeof(MeshVertex));
+			commands[command].firstInstance = static_cast<uint32_t>(run);
+
+			// Objects that share the mesh's geometry, they are sorted next to each other
+			for(; run < objectsEnd && drawOrder[run]->pipeline == rObj->pipeline && drawOrder[run]->vertexBuffer == rObj->vertexBuffer
+				  && drawOrder[run]->indexBuffer == rObj->indexBuffer; run++){
+				instances[run] = drawOrder[run]->transformSlot;
+				commands[command].instanceCount++;
+			}
+
+			command++;
+		}
 
-		vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelines[rObj->pipeline]);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelines[first->pipeline]);
 
 		// Binding the vertex buffer
 		/**
 		 * The last two parameters specify the array of vertex buffers to bind and the byte offsets to start reading
-		 * vertex data from.
+		 * vertex data from. The second binding is the attribute stream of the same vertices.
 		 */
-		VkBuffer vertexBuffers[] = { rObj->vertexBuffer->buffer };
-		VkDeviceSize offsets[] = { 0 };
-		vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, vertexBuffers, offsets);
+		VkBuffer vertexBuffers[] = { first->vertexBuffer->buffer, first->vertexBuffer->companion->buffer, instanceBuffers.buffer[i] };
+		VkDeviceSize offsets[] = { 0, 0, 0 };
+		vkCmdBindVertexBuffers(commandBuffer, 0, 3, vertexBuffers, offsets);
 
 		// Index buffer
-		vkCmdBindIndexBuffer(commandBuffers[i], rObj->indexBuffer->buffer, 0, VK_INDEX_TYPE_UINT16);
-
-		vkCmdPushConstants(commandBuffers[i], pipelineLayouts[0], VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshTransforms), &rObj->transforms);
+		vkCmdBindIndexBuffer(commandBuffer, first->indexBuffer->buffer, 0, first->indexType);
+
+		for(size_t k = runCommand; k < command;){
+			if(indirectDraws){
+				uint32_t count = static_cast<uint32_t>(std::min<size_t>(command - k, maxIndirectDraws));
+				vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffers.buffer[i], k * stride, count, stride);
+				k += count;
+			}else{
+				vkCmdDrawIndexed(commandBuffer, commands[k].indexCount, commands[k].instanceCount, commands[k].firstIndex,
+								 commands[k].vertexOffset, commands[k].firstInstance);
+				k++;
+			}
+		}
 
-		vkCmdDrawIndexed(commandBuffers[i], static_cast<uint32_t>(rObj->mesh.indices.size()), 1, 0, 0, 0);
+		j = run;
 	}
 
-	vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelines[1]);
+	if(springsBegin == springsEnd) return;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelines[1]);
+
+	// Springs share a few line buffers, the binding only changes between them
+	VkBuffer bound = VK_NULL_HANDLE;
+
+	for(size_t j = springsBegin; j < springsEnd; ++j){
+		Spring *spring = drawSprings[j];
+
+		if(spring->vertexBuffer->buffer != bound){
+			bound = spring->vertexBuffer->buffer;
 
-	if(drawMesh){
-		for(Spring *spring : Storage::springs){
-			VkBuffer vertexBuffers[] = {spring->vertexBuffer->buffer};
+			VkBuffer vertexBuffers[] = {bound};
 			VkDeviceSize offsets[] = {0};
-			vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, vertexBuffers, offsets);
-			vkCmdPushConstants(commandBuffers[i], pipelineLayouts[1], VK_SHADER_STAGE_VERTEX_BIT, 0,
-							   sizeof(MeshTransforms), &RenderComponent::identity);
-			vkCmdDraw(commandBuffers[i], static_cast<uint32_t>(spring->vertices.size()), 1, 0, 0);
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
 		}
-	}
-
-	// End render pass
-	vkCmdEndRenderPass(commandBuffers[i]);
 
-	// Finish recording the command buffer:
-	if(vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS){
-		throw std::runtime_error("failed to record command buffer!");
+		// Transform slot 0 is the identity
+		uint32_t firstVertex = static_cast<uint32_t>(spring->vertexBuffer->offset / sizeof(LineVertex));
+		vkCmdDraw(commandBuffer, static_cast<uint32_t>(spring->vertices.size()), 1, firstVertex, 0);
 	}
 }
 
@@ -2582,6 +3597,10 @@ void Vulkan::createSyncObjects(){
 			throw std::runtime_error("failed to create semaphores for a frame!");
 		}
 	}
+
+	if(vkCreateFence(device, &fenceInfo, nullptr, &computeFence) != VK_SUCCESS){
+		throw std::runtime_error("failed to create compute fence!");
+	}
 }
 
 QueueFamilyIndices Vulkan::findQueueFamilies(VkPhysicalDevice device){
@@ -2596,7 +3615,8 @@ QueueFamilyIndices Vulkan::findQueueFamilies(VkPhysicalDevice device){
 	int i = 0;
 	for(const auto &queueFamily : queueFamilies){
 		if(queueFamily.queueCount > 0){
-			if(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT){
+			// The cloth solver is dispatched on the graphics queue, so it has to support compute as well
+			if((queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) && (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT)){
 				indices.graphicsFamily = i;
 			}
 
@@ -2617,6 +3637,23 @@ QueueFamilyIndices Vulkan::findQueueFamilies(VkPhysicalDevice device){
 		i++;
 	}
 
+	// Prefer a family that only copies, DMA engines usually are exposed that way
+	for(uint32_t family = 0; family < queueFamilyCount; family++){
+		VkQueueFlags flags = queueFamilies[family].queueFlags;
+		if(queueFamilies[family].queueCount == 0 || !(flags & VK_QUEUE_TRANSFER_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT)) continue;
+
+		if(!indices.transferFamily.has_value() || !(flags & VK_QUEUE_COMPUTE_BIT)){
+			indices.transferFamily = family;
+		}
+	}
+
+	// Graphics queues can always copy, a second one of the graphics family still runs next to the first
+	if(!indices.transferFamily.has_value() && indices.graphicsFamily.has_value()
+	   && queueFamilies[indices.graphicsFamily.value()].queueCount > 1){
+		indices.transferFamily = indices.graphicsFamily;
+		indices.transferQueueIndex = 1;
+	}
+
 	return indices;
 }
 
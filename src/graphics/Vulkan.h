@@ -11,8 +11,11 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/string_cast.hpp>
+#include <glm/gtc/packing.hpp>
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <mutex>
 #include <iostream>
 #include <stdexcept>
@@ -22,17 +25,43 @@
 #include <set>
 #include <fstream>
 #include <optional>
+#include <array>
+#include <future>
 #include "BufferAllocation.h"
+#include "Shaders.h"
 
 const int WIDTH = 1500;
 const int HEIGHT = 900;
 
 const int MAX_FRAMES_IN_FLIGHT = 2;
 
+const int MAX_CLOTH_SYSTEMS = 16;
+const uint32_t CLOTH_BINDINGS = 6;
+const uint32_t CLOTH_GROUP_SIZE = 64;
+
+// Object transforms the storage buffer of every swap chain image starts with room for
+const size_t TRANSFORM_CAPACITY = 256;
+
+// Bytes of every uniform ring slice left for per-frame data besides the camera, lights and transforms
+const VkDeviceSize UNIFORM_SLICE_RESERVE = 64 << 10;
+
+// Draw commands the indirect buffer of every swap chain image starts with room for
+const size_t INDIRECT_CAPACITY = 256;
+
+// Upload batches in flight at once and the staging memory each of them starts with
+const size_t TRANSFER_BATCHES = 3;
+const VkDeviceSize TRANSFER_STAGING_SIZE = 8 << 20;
+
+// Pipeline cache kept between runs, discarded when it was written by a different device or driver
+const char* const PIPELINE_CACHE_FILE = "pipeline.cache";
+
+// Frames averaged for every recording time printed by --draw-bench
+const unsigned DRAW_BENCH_FRAMES = 100;
+
 struct glMassPoint {
 	alignas(16) glm::vec3 force;
 	alignas(16) glm::vec3 velocity;
-	bool fixed = false;
+	uint32_t fixed = 0;
 };
 
 struct glSpring {
@@ -43,6 +72,17 @@ struct glSpring {
 };
 
 
+struct ClothPushConstants {
+	glm::vec4 position;
+	glm::vec4 scale;
+	uint32_t stage;
+	uint32_t noPoints;
+	uint32_t colliderOffset;
+	uint32_t colliderCount;
+	float time;
+	float damping;
+};
+
 struct Vertex {
 	alignas(16) glm::vec3 pos;
 	alignas(16) glm::vec3 color;
@@ -133,6 +173,160 @@ struct Vertex {
 	}
 } __attribute__((aligned(16)));
 
+/**
+ * Vertex as the mesh pipelines read it, 24 bytes instead of the 64 of Vertex, in two streams. MeshVertex is the part the
+ * simulation changes and is uploaded every frame: the position in full precision and the normal octahedral encoded into
+ * two 16 bit snorms. MeshAttributes is uploaded once when the object is registered: the color in 8 bit unorm and the
+ * texture coordinates as halfs. Meshes and the simulation keep using Vertex, vertices are packed when they are uploaded.
+ */
+struct MeshVertex {
+	glm::vec3 pos;
+	uint32_t normal;
+
+	MeshVertex() = default;
+
+	explicit MeshVertex(const Vertex &vertex) : pos(vertex.pos), normal(glm::packSnorm2x16(encodeNormal(vertex.normal))){}
+
+	void unpack(Vertex &vertex) const{
+		vertex.pos = pos;
+		vertex.normal = decodeNormal(glm::unpackSnorm2x16(normal));
+	}
+
+	/**
+	 * Projects the normal onto the octahedron |x| + |y| + |z| = 1 and folds the lower half over the upper one, which
+	 * spreads the precision evenly over the sphere. Same as octEncode in cloth.comp.glsl.
+	 */
+	static glm::vec2 encodeNormal(const glm::vec3 &n){
+		float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+		if(sum == 0) return glm::vec2(0);
+
+		glm::vec2 p = glm::vec2(n) / sum;
+
+		if(n.z < 0){
+			p = (1.0f - glm::abs(glm::vec2(p.y, p.x))) * glm::vec2(p.x >= 0 ? 1.0f : -1.0f, p.y >= 0 ? 1.0f : -1.0f);
+		}
+
+		return p;
+	}
+
+	static glm::vec3 decodeNormal(const glm::vec2 &e){
+		glm::vec3 n(e, 1.0f - std::abs(e.x) - std::abs(e.y));
+		float t = std::max(-n.z, 0.0f);
+
+		n.x += n.x >= 0 ? -t : t;
+		n.y += n.y >= 0 ? -t : t;
+
+		return glm::normalize(n);
+	}
+
+	/**
+	 * Binding 0 is the MeshVertex stream, binding 1 the MeshAttributes stream. Both are indexed by the same vertex
+	 * index, see GeometryBuffer. Binding 2 advances per instance, the transform slot of each instance.
+	 */
+	static std::array<VkVertexInputBindingDescription, 3> getBindingDescriptions();
+
+	/**
+	 * Normalized formats are converted to floats by the vertex fetch, the shader inputs stay vec2/vec3.
+	 */
+	static std::array<VkVertexInputAttributeDescription, 5> getAttributeDescriptions();
+};
+
+struct MeshAttributes {
+	uint32_t color;
+	uint32_t texCoord;
+
+	MeshAttributes() = default;
+
+	explicit MeshAttributes(const Vertex &vertex) : color(glm::packUnorm4x8(glm::vec4(vertex.color, 1.0f))),
+			texCoord(glm::packHalf2x16(vertex.texCoord)){}
+};
+
+inline std::array<VkVertexInputBindingDescription, 3> MeshVertex::getBindingDescriptions() {
+	std::array<VkVertexInputBindingDescription, 3> bindingDescriptions = {};
+
+	bindingDescriptions[0].binding = 0;
+	bindingDescriptions[0].stride = sizeof(MeshVertex);
+	bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+	bindingDescriptions[1].binding = 1;
+	bindingDescriptions[1].stride = sizeof(MeshAttributes);
+	bindingDescriptions[1].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+	bindingDescriptions[2].binding = 2;
+	bindingDescriptions[2].stride = sizeof(uint32_t);
+	bindingDescriptions[2].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+	return bindingDescriptions;
+}
+
+inline std::array<VkVertexInputAttributeDescription, 5> MeshVertex::getAttributeDescriptions() {
+	std::array<VkVertexInputAttributeDescription, 5> attributeDescriptions = {};
+
+	attributeDescriptions[0].binding = 0;
+	attributeDescriptions[0].location = 0;
+	attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+	attributeDescriptions[0].offset = offsetof(MeshVertex, pos);
+
+	attributeDescriptions[1].binding = 1;
+	attributeDescriptions[1].location = 1;
+	attributeDescriptions[1].format = VK_FORMAT_R8G8B8A8_UNORM;
+	attributeDescriptions[1].offset = offsetof(MeshAttributes, color);
+
+	attributeDescriptions[2].binding = 0;
+	attributeDescriptions[2].location = 2;
+	attributeDescriptions[2].format = VK_FORMAT_R16G16_SNORM;
+	attributeDescriptions[2].offset = offsetof(MeshVertex, normal);
+
+	attributeDescriptions[3].binding = 1;
+	attributeDescriptions[3].location = 3;
+	attributeDescriptions[3].format = VK_FORMAT_R16G16_SFLOAT;
+	attributeDescriptions[3].offset = offsetof(MeshAttributes, texCoord);
+
+	attributeDescriptions[4].binding = 2;
+	attributeDescriptions[4].location = 4;
+	attributeDescriptions[4].format = VK_FORMAT_R32_UINT;
+	attributeDescriptions[4].offset = 0;
+
+	return attributeDescriptions;
+}
+
+/**
+ * Vertex of the line pipeline, the springs only need a position and a color.
+ */
+struct LineVertex {
+	glm::vec3 pos;
+	uint32_t color;
+
+	LineVertex() = default;
+
+	LineVertex(const glm::vec3 &pos, const glm::vec3 &color) : pos(pos), color(glm::packUnorm4x8(glm::vec4(color, 1.0f))){}
+
+	static VkVertexInputBindingDescription getBindingDescription() {
+		VkVertexInputBindingDescription bindingDescription = {};
+		bindingDescription.binding = 0;
+		bindingDescription.stride = sizeof(LineVertex);
+		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+		return bindingDescription;
+	}
+
+	static std::array<VkVertexInputAttributeDescription, 2> getAttributeDescriptions() {
+		std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions = {};
+
+		attributeDescriptions[0].binding = 0;
+		attributeDescriptions[0].location = 0;
+		attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+		attributeDescriptions[0].offset = offsetof(LineVertex, pos);
+
+		attributeDescriptions[1].binding = 0;
+		attributeDescriptions[1].location = 1;
+		attributeDescriptions[1].format = VK_FORMAT_R8G8B8A8_UNORM;
+		attributeDescriptions[1].offset = offsetof(LineVertex, color);
+
+		return attributeDescriptions;
+	}
+};
+
 struct PointLight {
 	glm::vec3 pos;
 	glm::vec3 color;
@@ -169,6 +363,10 @@ struct QueueFamilyIndices {
 	std::optional<uint32_t> graphicsFamily;
 	std::optional<uint32_t> presentFamily;
 
+	// Queue for uploads: a family without graphics if there is one, otherwise a second queue of the graphics family
+	std::optional<uint32_t> transferFamily;
+	uint32_t transferQueueIndex = 0;
+
 	bool isComplete(){
 		return graphicsFamily.has_value() && presentFamily.has_value();
 	}
@@ -197,14 +395,29 @@ struct UBOLights {
 
 struct UniformBuffer {
 	std::vector<VkBuffer> buffer;
-	std::vector<VkDeviceMemory> memory;
+	std::vector<VmaAllocation> allocation;
 };
 
+/**
+ * Memory pools of the allocator. Pools keep kinds of buffers with different lifetimes out of each other's blocks and
+ * report their usage separately, everything else comes from the default pools of the allocator.
+ */
+enum class MemoryPool {
+	GEOMETRY, // vertices and indices
+	CLOTH, // state of the compute solver
+	STAGING // host memory uploads and downloads go through
+};
+
+const size_t MEMORY_POOLS = 3;
+
 struct DescriptorSet {
 	VkDescriptorSetLayout layout;
-	std::vector<VkDescriptorSet> set;
+	VkDescriptorSet set;
 };
 
+class RenderComponent;
+class Spring;
+
 class Vulkan {
 public:
 	struct {
@@ -222,13 +435,39 @@ public:
 	VkDevice device;
 	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
 
+	// Lives as long as the device, every buffer and image is allocated from it
+	VmaAllocator allocator = VK_NULL_HANDLE;
+	VmaPool getPool(MemoryPool pool) const;
+	void printMemoryStats();
+
 	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
-					  VkBuffer& buffer, VkDeviceMemory& bufferMemory);
+					  VkBuffer& buffer, VmaAllocation& allocation, VmaPool pool = VK_NULL_HANDLE);
 	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize offset, VkDeviceSize size);
+	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize srcOffset, VkDeviceSize dstOffset, VkDeviceSize size);
 		VkCommandBuffer beginSingleTimeCommands();
 		void endSingleTimeCommands(VkCommandBuffer commandBuffer);
 
 	void recordCommandBuffer(size_t i);
+		void recordSecondary(size_t chunk, size_t i, size_t objectsBegin, size_t objectsEnd, size_t springsBegin, size_t springsEnd);
+		void recordDraws(VkCommandBuffer commandBuffer, size_t i, size_t objectsBegin, size_t objectsEnd, size_t springsBegin, size_t springsEnd);
+	void invalidateCommandBuffers();
+
+	VkDeviceSize getStorageAlignment() const;
+
+	// Per-frame constants, valid until the same swap chain image is drawn again
+	void* allocateUniforms(VkDeviceSize size, uint32_t &offset);
+
+	// Batched uploads
+	void queueUpload(VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size, const void* data);
+	void flushUploads();
+
+	// Cloth compute
+	VkDescriptorSet createClothDescriptorSet(const std::array<const BufferAllocation*, CLOTH_BINDINGS>& buffers);
+	void updateClothDescriptorSet(VkDescriptorSet set, uint32_t binding, const BufferAllocation *buffer);
+	void freeClothDescriptorSet(VkDescriptorSet set);
+	void beginClothCompute();
+	void dispatchCloth(VkDescriptorSet set, ClothPushConstants params, int steps);
+	void endClothCompute();
 
 private:
 
@@ -238,14 +477,112 @@ private:
 
 	VkQueue graphicsQueue;
 	VkQueue presentQueue;
+
+	// Uploads run on their own queue if the device has one, otherwise on the graphics queue, see flushUploads
+	VkQueue transferQueue = VK_NULL_HANDLE;
+	VkCommandPool transferPool = VK_NULL_HANDLE;
+	uint32_t graphicsFamily = 0;
+	uint32_t transferFamily = 0;
 	VkCommandPool commandPool;
 	std::vector <VkCommandBuffer> commandBuffers;
+
+	// Command buffers are only recorded again when what they draw changes, see invalidateCommandBuffers
+	std::vector<bool> commandBufferDirty;
+	std::vector<VkFence> imagesInFlight;
+
+	// With more than one draw chunk, every chunk records a secondary command buffer per image on a worker thread, from
+	// its own command pool
+	std::vector<VkCommandPool> drawPools;
+	std::vector<std::vector<VkCommandBuffer>> secondaryBuffers;
+
+	// Render objects sorted so that objects drawn with the same pipeline and geometry buffers are next to each other,
+	// each such run is one indirect draw and objects sharing a mesh one instanced command of it. The commands are
+	// written to the image's indirect buffer while recording.
+	std::vector<RenderComponent*> drawOrder;
+
+	// Springs drawn by this recording, taken on the recording thread since Storage is per thread
+	std::vector<Spring*> drawSprings;
+	UniformBuffer indirectBuffers;
+	std::vector<VkDrawIndexedIndirectCommand*> indirectCommands;
+
+	// Transform slot of every drawn object, the per instance vertex stream of the mesh pipelines
+	UniformBuffer instanceBuffers;
+	std::vector<uint32_t*> instanceSlots;
+	size_t indirectCapacity = INDIRECT_CAPACITY;
+
+	// Runs are drawn by one indirect draw if the device can, by one indirect draw per object if it can't take more
+	// than one at once, and with plain draws if indirect draws can't set the first instance (the transform slot)
+	bool indirectDraws = false;
+	uint32_t maxIndirectDraws = 1;
+
+	/*
+	 * Uploads are copied into the staging memory of the current batch and recorded into its command buffer, which is
+	 * submitted once by flushUploads. The batches form a ring, a batch is only reused once its fence says the copies
+	 * submitted from it are done, and its staging buffer only grows when a single upload doesn't fit.
+	 */
+	struct TransferBatch {
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;
+		VkBuffer staging = VK_NULL_HANDLE;
+		VmaAllocation stagingAllocation = VK_NULL_HANDLE;
+		char* stagingData = nullptr;
+		VkDeviceSize capacity = 0;
+		VkDeviceSize used = 0;
+		bool recording = false;
+
+		// With a transfer queue the copies are submitted there, then acquireBuffer is submitted on the graphics
+		// queue and waits for the semaphore. If the queues are from different families, the written ranges are
+		// released by the transfer queue and acquired by the graphics queue.
+		VkCommandBuffer acquireBuffer = VK_NULL_HANDLE;
+		VkSemaphore semaphore = VK_NULL_HANDLE;
+		std::vector<VkBufferMemoryBarrier> ownership;
+	};
+
+	std::array<TransferBatch, TRANSFER_BATCHES> transferBatches;
+	size_t transferBatch = 0;
+
+	// Signaled by every frame when uploads run on a transfer queue, waited for by the next transfer, so it doesn't
+	// overwrite vertices the frame is still drawing. A frame without uploads after it waits for it itself.
+	std::vector<VkSemaphore> drawSemaphores;
+	VkSemaphore pendingDrawSemaphore = VK_NULL_HANDLE;
+
+	// Startup times, printed once the first frame is presented
+	std::chrono::high_resolution_clock::time_point initStart;
+	double pipelineTime = 0;
+	bool pipelineCacheHit = false;
+	bool firstFrame = true;
+
+	// Recording times for --draw-bench
+	double recordTime = 0;
+	unsigned recordCount = 0;
 	VkCommandBuffer computeCommandBuffer;
+	VkFence computeFence;
 
-	std::vector<UniformBuffer> uniformBuffers;
+	/**
+	 * One persistently mapped buffer holds the view and projection, lights and object transforms of every frame. It
+	 * is split into a slice per swap chain image, a frame allocates from the slice of its image by moving head, and the
+	 * image fence in drawFrame guarantees the slice isn't read anymore. The descriptor sets are dynamic, the offsets of
+	 * an image are recorded into its command buffer and stay the same as long as the allocations do.
+	 */
+	struct UniformRing {
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VmaAllocation allocation = VK_NULL_HANDLE;
+		char* data = nullptr;
+		VkDeviceSize alignment = 0;
+		VkDeviceSize sliceSize = 0;
+		VkDeviceSize head = 0;
+		VkDeviceSize end = 0;
+	};
+
+	UniformRing uniformRing;
+	std::vector<std::array<uint32_t, 3>> uniformOffsets; // dynamic offsets of the three sets, per image
+	size_t transformCapacity = TRANSFORM_CAPACITY;
 	std::vector<DescriptorSet> descriptorSets;
 	VkDescriptorPool descriptorPool;
 
+	// Indexed by MemoryPool
+	std::array<VmaPool, MEMORY_POOLS> pools = {};
+
 	VkSwapchainKHR swapChain;
 	VkFormat swapChainImageFormat;
 	VkExtent2D swapChainExtent;
@@ -254,7 +591,7 @@ private:
 	std::vector <VkFramebuffer> swapChainFramebuffers;
 
 	VkImage depthImage;
-	VkDeviceMemory depthImageMemory;
+	VmaAllocation depthImageAllocation;
 	VkImageView depthImageView;
 
 	std::vector <VkFence> inFlightFences;
@@ -267,6 +604,12 @@ private:
 	VkRenderPass renderPass;
 	std::vector<VkPipelineLayout> pipelineLayouts;
 	std::vector<VkPipeline> graphicsPipelines;
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+
+	VkDescriptorSetLayout computeSetLayout;
+	VkPipelineLayout computePipelineLayout;
+	VkPipeline computePipeline;
+	VkDescriptorPool computeDescriptorPool;
 
 	// Run
 	void initMisc();
@@ -293,6 +636,9 @@ private:
 		bool isDeviceSuitable(VkPhysicalDevice device); // from pickPhysicalDevice
 			bool checkDeviceExtensionSupport(VkPhysicalDevice device); // from isDeviceSuitable
 	void createLogicalDevice();
+	void createAllocator();
+		void createPool(MemoryPool pool, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage); // from createAllocator
+	void destroyAllocator(); // from cleanup
 	void createSwapChain();
 		SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device); // from createSwapChain
 		VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector <VkSurfaceFormatKHR> &availableFormats); // from createSwapChain
@@ -302,15 +648,20 @@ private:
 	void createRenderPass();
 	void createDescriptorSetLayouts();
 		void createDescriptorSetLayout(VkShaderStageFlags stageFlags, VkDescriptorType descriptorType, uint32_t binding, VkDescriptorSetLayout *layout);
+	void createPipelineCache();
+		bool validPipelineCache(const std::vector<char> &data); // from createPipelineCache
+	void savePipelineCache(); // from cleanup
 	void createGraphicsPipeline();
 		void createTopoPipeline();
 		void createLinePipeline();
 		void createClothPipeline();
-		VkShaderModule createShaderModule(const std::vector<char> &code); // from createGraphicsPipeline
+		VkShaderModule createShaderModule(const ShaderCode &code); // from createGraphicsPipeline
+	void createComputePipeline();
+		void computeBarrier(); // from dispatchCloth
 	void createFramebuffers();
 	void createCommandPool();
 	// Images
-	void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory);
+	void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VmaAllocation& imageAllocation);
 	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
 	void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
 	void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
@@ -321,11 +672,23 @@ private:
 			VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features); // from findDepthFormat
 		uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties); // from createVertexBuffer
 	void createUniformBuffers();
+		void growTransformBuffers(size_t capacity); // from updateUniformBuffer
+		void beginUniforms(uint32_t image); // from updateUniformBuffer
+	void destroyUniformBuffers();
+	void createIndirectBuffers();
+		void growIndirectBuffers(size_t capacity); // from recordCommandBuffer
 	void createDescriptorPool();
 	void createDescriptorSets();
-		void createBufferDescriptorSet(VkDescriptorSetLayout layout, VkDescriptorSet *pos, UniformBuffer buffer, VkDeviceSize bufferSize);
+		void writeUniformDescriptors(); // from createDescriptorSets, growTransformBuffers
+			void writeBufferDescriptor(VkDescriptorSet set, VkBuffer buffer, VkDeviceSize bufferSize, VkDescriptorType descriptorType); // from writeUniformDescriptors
 	void createCommandBuffers();
 	void createSyncObjects();
+	void createTransferBatches();
+		void beginTransferBatch(TransferBatch &batch, VkDeviceSize size); // from queueUpload
+		void createStaging(TransferBatch &batch, VkDeviceSize capacity);
+		void destroyStaging(TransferBatch &batch);
+		void submitTransferQueue(TransferBatch &batch); // from flushUploads
+	void destroyTransferBatches();
 
 	// from createCommandPool, createLogicalDevice, createSwapChain, isDeviceSuitable
 	QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
@@ -0,0 +1,19 @@
+#ifndef VULK_IFRAMEBOUND_H
+#define VULK_IFRAMEBOUND_H
+
+#include <glm/glm.hpp>
+
+// Camera of the frame being drawn
+struct FrameView {
+	glm::mat4 view;
+	glm::mat4 proj;
+	float height; // of the viewport in pixels
+};
+
+// Updated once per drawn frame instead of every physics step
+class IFrameBound {
+public:
+	virtual void frameUpdate(const FrameView& view) = 0;
+};
+
+#endif //VULK_IFRAMEBOUND_H
@@ -1,24 +1,183 @@
 #include "Game.h"
 #include "data.h"
+#include "Sweep.h"
+#include <cstring>
+#include <memory>
 
-int noPoints = 10;
+thread_local int noPoints = 10;
+thread_local SimulationParameters simulationParameters;
+bool gpuCloth = false;
+PointOrder pointOrder = PointOrder::ROW;
+std::string sceneFile;
+std::string checkpointFile = "checkpoint.ckp";
+bool restoreCheckpoint = false;
+std::string playbackFile;
+bool deterministic = false;
+bool clothLod = false;
+bool clothSleep = false;
+unsigned clothRefine = 0;
+unsigned drawThreads = 0;
+bool drawBench = false;
+bool memoryStats = false;
+bool sceneStats = false;
 
 int main(int argc, char** argv){
 	Game game;
 
 	int scene = 1;
-	if(argc >= 2){
-		scene = atoi(argv[1]);
+	int verifySteps = 0;
+	int benchSteps = 0;
+	std::string exportFile;
+	double settleTime = 10;
+	bool saveCheckpoint = false;
+	std::string recordFile;
+	bool recordNormals = false;
+	int recordFrames = 600;
+	float recordFps = 60;
+	std::string goldenFile;
+	unsigned seed = time(0);
+	bool seedSet = false;
+	int threads = 1;
+	bool threadsSet = false;
+	bool sweep = false;
+	std::string sweepGrid;
+	std::string sweepOutput = "sweep.csv";
+	int sweepSteps = 2000;
+	int positional = 0;
+
+	for(int i = 1; i < argc; i++){
+		if(strcmp(argv[i], "--gpu") == 0){
+			gpuCloth = true;
+		}else if(strncmp(argv[i], "--verify-gpu", 12) == 0){
+			gpuCloth = true;
+			verifySteps = argv[i][12] == '=' ? atoi(argv[i] + 13) : 100;
+		}else if(strncmp(argv[i], "--bench", 7) == 0){
+			benchSteps = argv[i][7] == '=' ? atoi(argv[i] + 8) : 1000;
+		}else if(strncmp(argv[i], "--order=", 8) == 0){
+			pointOrder = parsePointOrder(argv[i] + 8);
+		}else if(strncmp(argv[i], "--export-scene=", 15) == 0){
+			exportFile = argv[i] + 15;
+		}else if(strncmp(argv[i], "--scene-file=", 13) == 0){
+			sceneFile = argv[i] + 13;
+		}else if(strncmp(argv[i], "--checkpoint=", 13) == 0){
+			checkpointFile = argv[i] + 13;
+			restoreCheckpoint = true;
+		}else if(strncmp(argv[i], "--save-checkpoint=", 18) == 0){
+			checkpointFile = argv[i] + 18;
+			saveCheckpoint = true;
+		}else if(strncmp(argv[i], "--settle=", 9) == 0){
+			settleTime = atof(argv[i] + 9);
+		}else if(strncmp(argv[i], "--record=", 9) == 0){
+			recordFile = argv[i] + 9;
+		}else if(strcmp(argv[i], "--record-normals") == 0){
+			recordNormals = true;
+		}else if(strncmp(argv[i], "--frames=", 9) == 0){
+			recordFrames = atoi(argv[i] + 9);
+		}else if(strncmp(argv[i], "--fps=", 6) == 0){
+			recordFps = atof(argv[i] + 6);
+		}else if(strncmp(argv[i], "--playback=", 11) == 0){
+			playbackFile = argv[i] + 11;
+		}else if(strcmp(argv[i], "--lod") == 0){
+			clothLod = true;
+		}else if(strcmp(argv[i], "--sleep") == 0){
+			clothSleep = true;
+		}else if(strncmp(argv[i], "--refine=", 9) == 0){
+			clothRefine = atoi(argv[i] + 9);
+		}else if(strncmp(argv[i], "--draw-threads=", 15) == 0){
+			drawThreads = atoi(argv[i] + 15);
+		}else if(strcmp(argv[i], "--draw-bench") == 0){
+			drawBench = true;
+		}else if(strcmp(argv[i], "--memory-stats") == 0){
+			memoryStats = true;
+		}else if(strcmp(argv[i], "--scene-stats") == 0){
+			sceneStats = true;
+		}else if(strcmp(argv[i], "--deterministic") == 0){
+			deterministic = true;
+		}else if(strncmp(argv[i], "--seed=", 7) == 0){
+			seed = strtoul(argv[i] + 7, nullptr, 10);
+			seedSet = true;
+		}else if(strncmp(argv[i], "--threads=", 10) == 0){
+			threads = atoi(argv[i] + 10);
+			threadsSet = true;
+		}else if(strncmp(argv[i], "--golden=", 9) == 0){
+			goldenFile = argv[i] + 9;
+			benchSteps = benchSteps > 0 ? benchSteps : 1000;
+		}else if(strncmp(argv[i], "--sweep=", 8) == 0){
+			sweepGrid = argv[i] + 8;
+			sweep = true;
+		}else if(strncmp(argv[i], "--sweep-out=", 12) == 0){
+			sweepOutput = argv[i] + 12;
+		}else if(strncmp(argv[i], "--sweep-steps=", 14) == 0){
+			sweepSteps = atoi(argv[i] + 14);
+		}else if(positional++ == 0){
+			scene = atoi(argv[i]);
+		}else{
+			noPoints = atoi(argv[i]);
+		}
+	}
+
+	// Scene 0 is the one loaded from the scene file
+	if(!sceneFile.empty()){
+		scene = 0;
+	}
+
+	if(deterministic && !seedSet){
+		seed = 0;
 	}
 
-	if(argc >= 3){
-		noPoints = atoi(argv[2]);
+	srand(seed);
+
+	// Zero uses every core, so do sweeps unless told otherwise
+	if(threads <= 0 || (sweep && !threadsSet)){
+		threads = std::max(1u, std::thread::hardware_concurrency());
 	}
 
-	srand(time(0));
+	// Sweeps run one scene per thread instead
+	std::unique_ptr<ThreadPool> pool;
+	if(threads > 1 && !sweep){
+		pool.reset(new ThreadPool(threads));
+		PhysicsEngine::threadPool = pool.get();
+	}
 
 	try{
+		if(sweep){
+			gpuCloth = false;
+
+			Sweep runner(scene, noPoints, sweepSteps);
+			runner.parseGrid(sweepGrid);
+			return runner.run(threads, sweepOutput);
+		}
+
+		if(!exportFile.empty()){
+			return game.exportScene(scene, exportFile);
+		}
+
+		if(saveCheckpoint){
+			gpuCloth = false;
+			return game.settle(scene, settleTime);
+		}
+
+		if(!recordFile.empty()){
+			gpuCloth = false;
+			return game.record(scene, recordFile, recordFrames, recordFps, recordNormals);
+		}
+
+		// The cache feeds the vertices on the processor side
+		if(!playbackFile.empty()){
+			gpuCloth = false;
+		}
+
+		if(benchSteps > 0){
+			gpuCloth = false;
+			return game.benchmark(scene, benchSteps, goldenFile);
+		}
+
 		game.init(scene);
+
+		if(verifySteps > 0){
+			return game.verifyCompute(verifySteps);
+		}
+
 		game.run();
 	}catch(const std::exception &e){
 		std::cerr << e.what() << std::endl;
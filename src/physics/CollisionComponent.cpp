@@ -8,7 +8,11 @@ CollisionComponent::CollisionComponent(WorldObject *object, ICollisionObject *co
 }
 
 glm::vec3 CollisionComponent::collide(glm::vec3 test){
-	return collisionObject->collision(test, object->position);
+	return collisionObject->collision(test, object->getPosition());
+}
+
+glm::vec4 CollisionComponent::getSphere() const{
+	return glm::vec4(object->getPosition(), collisionObject->getRadius());
 }
 
 WorldObject *CollisionComponent::getObject() const{
@@ -16,5 +20,6 @@ WorldObject *CollisionComponent::getObject() const{
 }
 
 void CollisionComponent::cleanup(){
-	delete collisionObject;
+	// The collision object is owned by the Storage pools
+	collisionObject = nullptr;
 }
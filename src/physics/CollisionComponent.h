@@ -12,6 +12,7 @@ public:
 	CollisionComponent(WorldObject *object, ICollisionObject *collisionObject);
 
 	glm::vec3 collide(glm::vec3 test);
+	glm::vec4 getSphere() const;
 
 	WorldObject *getObject() const;
 
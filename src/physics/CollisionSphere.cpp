@@ -12,4 +12,8 @@ glm::vec3 CollisionSphere::collision(glm::vec3 test, glm::vec3 pos){
 	return { 0, 0, 0 };
 }
 
+float CollisionSphere::getRadius() const{
+	return r;
+}
+
 CollisionSphere::CollisionSphere(float r) : r(r){}
@@ -10,6 +10,7 @@ public:
 	CollisionSphere(float r);
 
 	virtual glm::vec3 collision(glm::vec3 test, glm::vec3 pos);
+	virtual float getRadius() const;
 
 private:
 	float r;
@@ -7,6 +7,9 @@
 class ICollisionObject {
 public:
 	virtual glm::vec3 collision(glm::vec3 test, glm::vec3 pos) = 0;
+
+	// Radius of the bounding sphere, the GPU cloth solver treats every collider as a sphere
+	virtual float getRadius() const = 0;
 };
 
 
@@ -1,14 +1,31 @@
 #include "PhysicsEngine.h"
 #include "../Game.h"
 #include "../storage/Storage.h"
+#include "../springsystem/ClothLOD.h"
+#include "../data.h"
 
-std::vector<CollisionComponent*> PhysicsEngine::colComps;
-std::vector<IPhysicsComponent*> PhysicsEngine::physComps;
+thread_local std::vector<CollisionComponent*> PhysicsEngine::colComps;
+thread_local std::vector<IPhysicsComponent*> PhysicsEngine::physComps;
+thread_local int PhysicsEngine::pendingSteps = 0;
+thread_local std::vector<glm::vec4> PhysicsEngine::pendingColliders;
+thread_local ThreadPool* PhysicsEngine::threadPool = nullptr;
 
 void PhysicsEngine::update(double time){
 	time += timeResidue;
 
 	while((time - TIME_DELTA) > 0){
+		step(1);
+		time -= TIME_DELTA;
+	}
+
+	timeResidue = time;
+}
+
+/**
+ * Runs the given number of steps regardless of the time that passed, the residue is left untouched.
+ */
+void PhysicsEngine::step(int steps){
+	for(int s = 0; s < steps; s++){
 		for(IPhysicsComponent* physComp : physComps){
 			physComp->resetForce();
 		}
@@ -17,6 +34,14 @@ void PhysicsEngine::update(double time){
 			obj->update(TIME_DELTA);
 		}
 
+		if(gpuCloth){
+			for(CollisionComponent* colComp : colComps){
+				pendingColliders.push_back(colComp->getSphere());
+			}
+
+			pendingSteps++;
+		}
+
 		for(int i = 0; i < physComps.size(); i++){
 			for(int j = 0; j < colComps.size(); j++){
 				physComps[i]->collide(colComps[j]);
@@ -26,23 +51,66 @@ void PhysicsEngine::update(double time){
 		for(IPhysicsComponent* physComp : physComps){
 			physComp->update(TIME_DELTA);
 		}
+	}
+}
 
-		time -= TIME_DELTA;
+double PhysicsEngine::getTimeResidue() const{
+	return timeResidue;
+}
+
+void PhysicsEngine::setTimeResidue(double timeResidue){
+	PhysicsEngine::timeResidue = timeResidue;
+}
+
+/**
+ * FNV-1a hash of the positions and velocities of every cloth point and the positions of the objects, two runs
+ * produced the same trajectory only if their hashes match. Cloths running on a coarser level add that level's points,
+ * the full resolution system only follows its positions.
+ */
+uint64_t PhysicsEngine::stateHash(){
+	uint64_t hash = 0xcbf29ce484222325;
+
+	auto add = [&](const void* data, size_t bytes){
+		for(size_t i = 0; i < bytes; i++){
+			hash ^= static_cast<const uint8_t*>(data)[i];
+			hash *= 0x100000001b3;
+		}
+	};
+
+	for(WorldObject* obj : Storage::worldObjects){
+		add(&obj->getPosition(), sizeof(glm::vec3));
 	}
 
-	timeResidue = time;
+	auto addSystem = [&](SpringSystem* system){
+		for(int i = 0; i < system->getNoPoints(); i++){
+			glm::vec3 position = system->getPoint(i)->getPosition();
+			add(&position, sizeof(glm::vec3));
+			add(&system->getPoint(i)->getVelocity(), sizeof(glm::vec3));
+		}
+	};
+
+	for(SpringSystem* system : Storage::sSystems){
+		addSystem(system);
+	}
+
+	for(ClothLOD* lod : Storage::clothLods){
+		unsigned level = lod->getLevel();
+		add(&level, sizeof(level));
+
+		if(level != 0) addSystem(lod->getActiveSystem());
+	}
+
+	return hash;
 }
 
 void PhysicsEngine::cleanup(){
+	// The components themselves are released with the rest of the scene in Storage::cleanup
 	for(CollisionComponent* c : colComps){
 		c->cleanup();
-		delete c;
-	}
-
-	for(IPhysicsComponent* c : physComps){
-		delete c;
 	}
 
 	colComps.clear();
 	physComps.clear();
+	pendingColliders.clear();
+	pendingSteps = 0;
 }
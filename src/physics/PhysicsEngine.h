@@ -7,6 +7,7 @@
 #include "CollisionComponent.h"
 #include "StandardPhysicsComponent.h"
 #include "../graphics/Graphics.h"
+#include "ThreadPool.h"
 
 #define TIME_DELTA 0.001
 
@@ -14,13 +15,27 @@ class PhysicsEngine : public ITimeBound {
 public:
 	void update(double time) override;
 	void update(double time, Graphics* graphics);
+	void step(int steps);
 
 
-	static std::vector<CollisionComponent*> colComps;
-	static std::vector<IPhysicsComponent*> physComps;
+	static thread_local std::vector<CollisionComponent*> colComps;
+	static thread_local std::vector<IPhysicsComponent*> physComps;
+
+	// Steps not yet simulated by the GPU cloth solver, with the collider spheres of every step
+	static thread_local int pendingSteps;
+	static thread_local std::vector<glm::vec4> pendingColliders;
+
+	// Spreads the cloth solver over several threads when set, see SpringSystem::updateParallel. Like the rest of the
+	// engine state it belongs to the thread running the simulation.
+	static thread_local ThreadPool* threadPool;
 
 	static void cleanup();
 
+	static uint64_t stateHash();
+
+	double getTimeResidue() const;
+	void setTimeResidue(double timeResidue);
+
 private:
 	double timeResidue = 0;
 };
@@ -9,9 +9,9 @@ void StandardPhysicsComponent::update(double time){
 	velocity += force * (float) pow(time, 1);
 	//position += velocity * (float) pow(time, 1);
 
-	glm::vec3 pl = object->position;
-	if(glm::length(posLast) < 0.01) posLast = object->position;
-	object->position = object->position * 2.0f - posLast + force * (float) pow(time, 2);
+	glm::vec3 pl = object->getPosition();
+	if(glm::length(posLast) < 0.01) posLast = object->getPosition();
+	object->setPosition(object->getPosition() * 2.0f - posLast + force * (float) pow(time, 2));
 	posLast = pl;
 }
 
@@ -0,0 +1,92 @@
+#include <algorithm>
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(unsigned threads){
+	// The calling thread is one of them
+	for(unsigned i = 1; i < threads; i++){
+		workers.emplace_back(&ThreadPool::run, this);
+	}
+}
+
+ThreadPool::~ThreadPool(){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+
+	wake.notify_all();
+
+	for(std::thread& worker : workers){
+		worker.join();
+	}
+}
+
+unsigned ThreadPool::size() const{
+	return workers.size() + 1;
+}
+
+/**
+ * Calls fn(begin, end) for consecutive blocks of [0, count). Which thread gets a block isn't fixed, so fn may only
+ * write to data belonging to its own range.
+ */
+void ThreadPool::parallelFor(size_t count, size_t block, const std::function<void(size_t, size_t)> &fn){
+	block = std::max<size_t>(block, 1);
+
+	if(workers.empty() || count <= block){
+		for(size_t begin = 0; begin < count; begin += block){
+			fn(begin, std::min(begin + block, count));
+		}
+
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = &fn;
+		ThreadPool::count = count;
+		ThreadPool::block = block;
+		next = 0;
+		finishedWorkers = 0;
+		generation++;
+	}
+
+	wake.notify_all();
+	work();
+
+	// Every worker has to check in, a late one could otherwise still be reading the job
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this]{ return finishedWorkers == workers.size(); });
+	job = nullptr;
+}
+
+void ThreadPool::run(){
+	uint64_t seen = 0;
+
+	while(true){
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&]{ return stopping || generation != seen; });
+
+			if(stopping) return;
+			seen = generation;
+		}
+
+		work();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			finishedWorkers++;
+		}
+
+		done.notify_one();
+	}
+}
+
+void ThreadPool::work(){
+	while(true){
+		size_t begin = next.fetch_add(block);
+		if(begin >= count) return;
+
+		(*job)(begin, std::min(begin + block, count));
+	}
+}
@@ -0,0 +1,50 @@
+#ifndef VULK_THREADPOOL_H
+#define VULK_THREADPOOL_H
+
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of worker threads running one parallel loop at a time. The calling thread works on the loop as well and
+ * returns once every block is done.
+ */
+class ThreadPool {
+public:
+	explicit ThreadPool(unsigned threads);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	unsigned size() const;
+
+	void parallelFor(size_t count, size_t block, const std::function<void(size_t, size_t)> &fn);
+
+private:
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+
+	const std::function<void(size_t, size_t)>* job = nullptr;
+	size_t count = 0;
+	size_t block = 1;
+	std::atomic<size_t> next{ 0 };
+
+	uint64_t generation = 0;
+	unsigned finishedWorkers = 0;
+	bool stopping = false;
+
+	void run();
+	void work();
+};
+
+
+#endif //VULK_THREADPOOL_H
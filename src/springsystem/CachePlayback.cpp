@@ -0,0 +1,77 @@
+#include <algorithm>
+#include <stdexcept>
+#include "CachePlayback.h"
+#include "../storage/Storage.h"
+#include "../physics/PhysicsEngine.h"
+
+CachePlayback::CachePlayback(const std::string &filename) : cache(filename){
+	ArrayView<CacheSystem> recorded = cache.getSystems();
+
+	if(recorded.size != Storage::sSystems.size()){
+		throw std::runtime_error("simulation cache " + filename + " was recorded in a different scene!");
+	}
+
+	for(uint32_t i = 0; i < recorded.size; i++){
+		SpringSystem* system = Storage::sSystems[i];
+
+		if(recorded[i].object >= Storage::worldObjects.size() || Storage::worldObjects[recorded[i].object] != system->object
+		   || recorded[i].pointCount != system->object->renderComponent->mesh.vertices.size()){
+			throw std::runtime_error("simulation cache " + filename + " was recorded in a different scene!");
+		}
+
+		systems.push_back(system);
+	}
+
+	std::vector<IPhysicsComponent*>& physComps = PhysicsEngine::physComps;
+	for(SpringSystem* system : systems){
+		physComps.erase(std::remove(physComps.begin(), physComps.end(), system), physComps.end());
+		system->object->renderComponent->suppliedNormals = cache.hasNormals();
+	}
+
+	physComps.push_back(this);
+
+	show(0);
+}
+
+void CachePlayback::update(double time){
+	totalTime += time;
+
+	uint32_t target = totalTime / cache.getHeader().frameTime;
+	if(target != frame){
+		show(target);
+	}
+}
+
+void CachePlayback::resetForce(){
+}
+
+void CachePlayback::collide(CollisionComponent *collidor){
+}
+
+uint32_t CachePlayback::getFrame() const{
+	return frame;
+}
+
+void CachePlayback::show(uint32_t frame){
+	cache.seek(frame);
+	CachePlayback::frame = frame;
+
+	for(uint32_t s = 0; s < systems.size(); s++){
+		std::vector<Vertex>& vertices = systems[s]->object->renderComponent->mesh.vertices;
+		const std::vector<glm::vec3>& positions = cache.getPositions(s);
+
+		for(size_t i = 0; i < vertices.size(); i++){
+			vertices[i].pos = positions[i];
+		}
+
+		if(cache.hasNormals()){
+			const std::vector<glm::vec3>& normals = cache.getNormals(s);
+
+			for(size_t i = 0; i < vertices.size(); i++){
+				vertices[i].normal = normals[i];
+			}
+		}
+
+		systems[s]->wakeAll();
+	}
+}
@@ -0,0 +1,36 @@
+#ifndef VULK_CACHEPLAYBACK_H
+#define VULK_CACHEPLAYBACK_H
+
+
+#include <vector>
+#include "../physics/IPhysicsComponent.h"
+#include "../storage/SimulationCache.h"
+
+class SpringSystem;
+
+/**
+ * Replays a simulation cache in place of the spring systems of the loaded scene. The systems are taken out of the
+ * physics engine and the recorded vertices are written straight into their render components.
+ */
+class CachePlayback : public IPhysicsComponent {
+public:
+	explicit CachePlayback(const std::string &filename);
+
+	void update(double time) override;
+	void resetForce() override;
+	void collide(CollisionComponent* collidor) override;
+
+	uint32_t getFrame() const;
+
+private:
+	SimulationCache cache;
+	std::vector<SpringSystem*> systems;
+
+	double totalTime = 0;
+	uint32_t frame = 0;
+
+	void show(uint32_t frame);
+};
+
+
+#endif //VULK_CACHEPLAYBACK_H
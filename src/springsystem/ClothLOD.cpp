@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <cmath>
+#include "ClothLOD.h"
+#include "../storage/Storage.h"
+#include "../physics/PhysicsEngine.h"
+
+ClothLOD::ClothLOD(SpringSystem *system){
+	levels.push_back({ system->getN(), system });
+
+	const std::vector<std::vector<MassPoint*>>& grid = system->getMesh();
+
+	for(unsigned n = (system->getN() + 1) / 2; n >= LOD_MIN_POINTS; n = (n + 1) / 2){
+		std::vector<Vertex> vertices(n * n);
+
+		// Grid of the level laid over the full resolution cloth
+		for(unsigned i = 0; i < n; i++){
+			for(unsigned j = 0; j < n; j++){
+				vertices[i * n + j].pos = sample(levels[0], i / (float) (n - 1), j / (float) (n - 1), false);
+			}
+		}
+
+		surfaces.push_back(std::make_unique<Mesh>(vertices, std::vector<uint32_t>()));
+
+		SpringSystem* level = Storage::create<SpringSystem>(system->object, surfaces.back().get(), n, system->getMass());
+
+		for(unsigned i = 0; i < n; i++){
+			for(unsigned j = 0; j < n; j++){
+				unsigned fi = std::lround(i / (float) (n - 1) * (system->getN() - 1));
+				unsigned fj = std::lround(j / (float) (n - 1) * (system->getN() - 1));
+
+				if(grid[fi][fj]->isFixed()) level->setFixed(i, j, true);
+			}
+		}
+
+		levels.push_back({ n, level });
+	}
+
+	std::vector<IPhysicsComponent*>& physComps = PhysicsEngine::physComps;
+	std::replace(physComps.begin(), physComps.end(), (IPhysicsComponent*) system, (IPhysicsComponent*) this);
+
+	Storage::frameObjects.push_back(this);
+	Storage::clothLods.push_back(this);
+}
+
+void ClothLOD::update(double time){
+	levels[active].system->update(time);
+}
+
+void ClothLOD::resetForce(){
+	levels[active].system->resetForce();
+}
+
+void ClothLOD::collide(CollisionComponent *collidor){
+	levels[active].system->collide(collidor);
+}
+
+/**
+ * Picks the level for the cloth's size on screen and, while a coarser level runs, moves the render mesh to it.
+ */
+void ClothLOD::frameUpdate(const FrameView &view){
+	unsigned level = chooseLevel(view);
+	if(level != active){
+		switchLevel(level);
+	}
+
+	if(active != 0){
+		resample(levels[active], levels[0], true);
+		levels[0].system->wakeAll();
+	}
+}
+
+unsigned ClothLOD::getLevel() const{
+	return active;
+}
+
+SpringSystem* ClothLOD::getActiveSystem() const{
+	return levels[active].system;
+}
+
+/**
+ * Moves the cloth back to the full resolution system, which is the only level checkpoints store. The next frame picks
+ * the level for the view again.
+ */
+void ClothLOD::switchToFull(){
+	if(active != 0) switchLevel(0);
+}
+
+unsigned ClothLOD::chooseLevel(const FrameView &view) const{
+	const Level& level = levels[active];
+	WorldObject* object = level.system->object;
+
+	glm::vec3 min(INFINITY), max(-INFINITY);
+	for(int i = 0; i < level.system->getNoPoints(); i++){
+		glm::vec3 pos = level.system->getPoint(i)->getPosition() * object->getScale() + object->getPosition();
+		min = glm::min(min, pos);
+		max = glm::max(max, pos);
+	}
+
+	glm::vec3 center = glm::vec3(view.view * glm::vec4((min + max) * 0.5f, 1.0f));
+	float radius = glm::length(max - min) * 0.5f;
+	float depth = -center.z;
+
+	float scaleX = std::abs(view.proj[0][0]);
+	float scaleY = std::abs(view.proj[1][1]);
+
+	// Off screen
+	if(depth < -radius || std::abs(center.x) * scaleX - radius * scaleX > depth || std::abs(center.y) * scaleY - radius * scaleY > depth){
+		return levels.size() - 1;
+	}
+
+	if(depth <= radius) return 0;
+
+	float pixels = 2.0f * radius / depth * scaleY * view.height * 0.5f;
+	float cells = pixels / LOD_PIXELS_PER_CELL;
+
+	unsigned target = 0;
+	for(unsigned k = levels.size() - 1; k > 0; k--){
+		if(levels[k].n - 1 >= cells){
+			target = k;
+			break;
+		}
+	}
+
+	if(target > active && levels[target].n - 1 < cells * LOD_HYSTERESIS){
+		target = active;
+	}
+
+	return target;
+}
+
+void ClothLOD::switchLevel(unsigned level){
+	resample(levels[active], levels[level], true);
+	resample(levels[active], levels[level], false);
+	levels[level].system->wakeAll();
+
+	active = level;
+}
+
+/**
+ * Bilinear resampling of the grid positions or velocities of one level into another, fixed points stay where they are.
+ */
+void ClothLOD::resample(const Level &from, const Level &to, bool positions){
+	const std::vector<std::vector<MassPoint*>>& grid = to.system->getMesh();
+
+	for(unsigned i = 0; i < to.n; i++){
+		for(unsigned j = 0; j < to.n; j++){
+			MassPoint* point = grid[i][j];
+			if(point->isFixed()) continue;
+
+			glm::vec3 value = sample(from, i / (float) (to.n - 1), j / (float) (to.n - 1), !positions);
+
+			if(positions) point->setPosition(value);
+			else point->setVelocity(value);
+		}
+	}
+}
+
+glm::vec3 ClothLOD::sample(const Level &level, float u, float v, bool velocity){
+	const std::vector<std::vector<MassPoint*>>& grid = level.system->getMesh();
+
+	float x = u * (level.n - 1);
+	float y = v * (level.n - 1);
+
+	unsigned i = std::min((unsigned) x, level.n - 2);
+	unsigned j = std::min((unsigned) y, level.n - 2);
+	float fx = x - i;
+	float fy = y - j;
+
+	auto value = [&](unsigned a, unsigned b){
+		return velocity ? grid[a][b]->getVelocity() : grid[a][b]->getPosition();
+	};
+
+	return glm::mix(glm::mix(value(i, j), value(i, j + 1), fy), glm::mix(value(i + 1, j), value(i + 1, j + 1), fy), fx);
+}
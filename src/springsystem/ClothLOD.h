@@ -0,0 +1,58 @@
+#ifndef VULK_CLOTHLOD_H
+#define VULK_CLOTHLOD_H
+
+
+#include <memory>
+#include <vector>
+#include "SpringSystem.h"
+#include "../interfaces/IFrameBound.h"
+
+// Levels stop before the grid gets smaller than this
+#define LOD_MIN_POINTS 4
+
+// Grid cells the cloth should have for every this many pixels of its size on screen
+#define LOD_PIXELS_PER_CELL 8.0f
+
+// A coarser level is only taken once it has this much more resolution than needed, so a cloth at the threshold
+// doesn't switch back and forth
+#define LOD_HYSTERESIS 1.25f
+
+/**
+ * Simulates a cloth on a grid coarse enough for its size on screen. Level 0 is the full resolution spring system,
+ * every next level has about half as many points per side. While a coarser level runs, the render mesh is rebuilt from
+ * it once per frame. Positions and velocities are resampled when switching levels.
+ */
+class ClothLOD : public IPhysicsComponent, public IFrameBound {
+public:
+	explicit ClothLOD(SpringSystem *system);
+
+	void update(double time) override;
+	void resetForce() override;
+	void collide(CollisionComponent* collidor) override;
+
+	void frameUpdate(const FrameView& view) override;
+
+	unsigned getLevel() const;
+	SpringSystem* getActiveSystem() const;
+
+	void switchToFull();
+
+private:
+	struct Level {
+		unsigned n;
+		SpringSystem* system;
+	};
+
+	std::vector<Level> levels;
+	std::vector<std::unique_ptr<Mesh>> surfaces;
+	unsigned active = 0;
+
+	unsigned chooseLevel(const FrameView& view) const;
+	void switchLevel(unsigned level);
+	void resample(const Level& from, const Level& to, bool positions);
+
+	static glm::vec3 sample(const Level& level, float u, float v, bool velocity);
+};
+
+
+#endif //VULK_CLOTHLOD_H
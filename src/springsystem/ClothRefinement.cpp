@@ -0,0 +1,135 @@
+#include <algorithm>
+#include "ClothRefinement.h"
+#include "../graphics/MeshCache.h"
+#include "../physics/PhysicsEngine.h"
+#include "../world/WorldObject.h"
+
+// Fine rows handed to a thread at a time
+#define REFINE_BLOCK 16
+
+ClothRefinement::ClothRefinement(SpringSystem *system, unsigned levels) : system(system), n(system->getN()){
+	levels = std::min(levels, (unsigned) REFINE_MAX_LEVELS);
+	m = ((n - 1) << levels) + 1;
+
+	// Moving the mesh keeps its vertex array, the mass points keep pointing into it
+	RenderComponent* rObj = system->object->renderComponent;
+	coarse.reset(new Mesh(std::move(rObj->mesh)));
+	system->surface = coarse.get();
+	system->refinement = this;
+
+	rObj->mesh = *MeshCache::plane({ 0, 0 }, { 1, 1 }, m);
+
+	base.resize(m);
+	weights.resize(m);
+
+	for(unsigned f = 0; f < m; f++){
+		unsigned s = std::min(f >> levels, n - 2);
+		float u = f / (float) (1u << levels) - s;
+
+		// Padded index of control point s - 1
+		base[f] = s;
+		weights[f] = glm::vec4(
+				(1 - u) * (1 - u) * (1 - u),
+				3 * u * u * u - 6 * u * u + 4,
+				-3 * u * u * u + 3 * u * u + 3 * u + 1,
+				u * u * u
+		) / 6.0f;
+	}
+
+	control.resize((n + 2) * (n + 2) * 3);
+	rows.resize(m * (n + 2) * 3);
+
+	refine();
+}
+
+/**
+ * Moves the render mesh to the current positions of the simulated points.
+ */
+void ClothRefinement::refine(){
+	gatherControl();
+
+	ThreadPool* pool = PhysicsEngine::threadPool;
+	if(pool != nullptr){
+		pool->parallelFor(m, REFINE_BLOCK, [this](size_t begin, size_t end){ refineRows(begin, end); });
+		pool->parallelFor(m, REFINE_BLOCK, [this](size_t begin, size_t end){ refineColumns(begin, end); });
+	}else{
+		refineRows(0, m);
+		refineColumns(0, m);
+	}
+}
+
+unsigned ClothRefinement::getN() const{
+	return m;
+}
+
+void ClothRefinement::gatherControl(){
+	const std::vector<std::vector<MassPoint*>>& grid = system->getMesh();
+	unsigned stride = n + 2;
+
+	auto at = [&](unsigned i, unsigned j){
+		return &control[(i * stride + j) * 3];
+	};
+
+	for(unsigned i = 0; i < n; i++){
+		for(unsigned j = 0; j < n; j++){
+			glm::vec3 pos = grid[i][j]->getPosition();
+			float* c = at(i + 1, j + 1);
+			c[0] = pos.x; c[1] = pos.y; c[2] = pos.z;
+		}
+
+		float *first = at(i + 1, 0), *last = at(i + 1, n + 1);
+		for(int k = 0; k < 3; k++){
+			first[k] = 2 * at(i + 1, 1)[k] - at(i + 1, 2)[k];
+			last[k] = 2 * at(i + 1, n)[k] - at(i + 1, n - 1)[k];
+		}
+	}
+
+	for(unsigned k = 0; k < stride * 3; k++){
+		control[k] = 2 * control[stride * 3 + k] - control[2 * stride * 3 + k];
+		control[(n + 1) * stride * 3 + k] = 2 * control[n * stride * 3 + k] - control[(n - 1) * stride * 3 + k];
+	}
+}
+
+/**
+ * Fine rows as weighted sums of four padded control rows.
+ */
+void ClothRefinement::refineRows(size_t begin, size_t end){
+	size_t width = (n + 2) * 3;
+
+	for(size_t f = begin; f < end; f++){
+		const float* c0 = &control[base[f] * width];
+		const float* c1 = c0 + width;
+		const float* c2 = c1 + width;
+		const float* c3 = c2 + width;
+		float* row = &rows[f * width];
+		glm::vec4 w = weights[f];
+
+		for(size_t k = 0; k < width; k++){
+			row[k] = w.x * c0[k] + w.y * c1[k] + w.z * c2[k] + w.w * c3[k];
+		}
+	}
+}
+
+/**
+ * Fine vertices of every fine row as weighted sums of four of its points.
+ */
+void ClothRefinement::refineColumns(size_t begin, size_t end){
+	std::vector<Vertex>& vertices = system->object->renderComponent->mesh.vertices;
+	size_t width = (n + 2) * 3;
+
+	for(size_t f = begin; f < end; f++){
+		const float* row = &rows[f * width];
+		Vertex* out = &vertices[f * m];
+
+		for(unsigned g = 0; g < m; g++){
+			const float* c = row + base[g] * 3;
+			glm::vec4 w = weights[g];
+
+			out[g].pos = glm::vec3(
+					w.x * c[0] + w.y * c[3] + w.z * c[6] + w.w * c[9],
+					w.x * c[1] + w.y * c[4] + w.z * c[7] + w.w * c[10],
+					w.x * c[2] + w.y * c[5] + w.z * c[8] + w.w * c[11]
+			);
+		}
+	}
+}
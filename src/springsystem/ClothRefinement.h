@@ -0,0 +1,52 @@
+#ifndef VULK_CLOTHREFINEMENT_H
+#define VULK_CLOTHREFINEMENT_H
+
+
+#include <memory>
+#include <vector>
+#include "SpringSystem.h"
+
+// Every level doubles the number of grid cells per side of the rendered cloth
+#define REFINE_MAX_LEVELS 4
+
+/**
+ * Renders a cloth on a finer grid than it is simulated on. The render mesh is replaced by a grid with 2^levels times as
+ * many cells per side, whose vertices lie on the uniform cubic B-spline surface with the simulated points as control
+ * points, the surface Catmull-Clark subdivision converges to on a regular grid. Control points are mirrored over the
+ * border, so the surface still ends at the border of the cloth.
+ *
+ * The surface is separable, so refinement is two passes of four weighted rows or points per output. The first one
+ * runs over contiguous rows of floats and vectorizes.
+ */
+class ClothRefinement {
+public:
+	ClothRefinement(SpringSystem *system, unsigned levels);
+
+	void refine();
+
+	unsigned getN() const;
+
+private:
+	SpringSystem* system;
+
+	// The simulated vertices, moved out of the render component
+	std::unique_ptr<Mesh> coarse;
+
+	unsigned n;
+	unsigned m;
+
+	// First control point and the four basis weights of every fine row or column, the same in both directions
+	std::vector<uint32_t> base;
+	std::vector<glm::vec4> weights;
+
+	// (n + 2) x (n + 2) control points and m x (n + 2) after the first pass, three floats per point
+	std::vector<float> control;
+	std::vector<float> rows;
+
+	void gatherControl();
+	void refineRows(size_t begin, size_t end);
+	void refineColumns(size_t begin, size_t end);
+};
+
+
+#endif //VULK_CLOTHREFINEMENT_H
@@ -2,7 +2,7 @@
 #include <glm/glm.hpp>
 #include "MassPoint.h"
 
-MassPoint::MassPoint(Vertex* vertex, MeshTransforms* transforms, float mass) : vertex(vertex), transforms(transforms), mass(mass){}
+MassPoint::MassPoint(Vertex* vertex, float mass) : vertex(vertex), mass(mass){}
 
 void MassPoint::resetForce(){
 	//force = { 0, 0, -9.81 };
@@ -19,10 +19,14 @@ void MassPoint::addVelocity(glm::vec3 velocity){
 }
 
 void MassPoint::update(double time){
+	update(time, DEFAULT_DAMPING);
+}
+
+void MassPoint::update(double time, float damping){
 	if(fixed) return;
 
 	// damping
-	force += velocity * -3.0f;
+	force += velocity * -damping;
 
 	// gravity
 	force += glm::vec3( 0, 0, -9.81 );
@@ -42,6 +46,10 @@ void MassPoint::setFixed(bool fixed){
 	this->fixed = fixed;
 }
 
+bool MassPoint::isFixed() const{
+	return fixed;
+}
+
 void MassPoint::setPosition(const glm::vec3& position){
 	vertex->pos = position;
 }
@@ -54,6 +62,10 @@ const glm::vec3& MassPoint::getVelocity() const{
 	return velocity;
 }
 
+void MassPoint::setVelocity(const glm::vec3& velocity){
+	this->velocity = velocity;
+}
+
 float MassPoint::getMass() const{
 	return mass;
 }
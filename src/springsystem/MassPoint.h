@@ -6,20 +6,23 @@
 #include "../interfaces/ITimeBound.h"
 #include "../graphics/Vulkan.h"
 #include "../graphics/RenderComponent.h"
+#include "SimulationParameters.h"
 
 class MassPoint : public ITimeBound {
 public:
-	MassPoint(Vertex* vertex, MeshTransforms* transforms, float mass);
+	MassPoint(Vertex* vertex, float mass);
 
 	void resetForce();
 	void addForce(glm::vec3 force);
 	void addVelocity(glm::vec3 velocity);
 
 	void update(double time) override;
+	void update(double time, float damping);
 
 	glm::vec3 getPosition() const;
 
 	const glm::vec3& getVelocity() const;
+	void setVelocity(const glm::vec3& velocity);
 
 	void setPosition(const glm::vec3& position);
 	void move(const glm::vec3& direction);
@@ -27,11 +30,11 @@ public:
 	float getMass() const;
 
 	void setFixed(bool fixed);
+	bool isFixed() const;
 
 private:
 	//glm::vec3 position;
 	Vertex* vertex;
-	MeshTransforms* transforms;
 	glm::vec3 velocity = { 0, 0, 0 };
 	glm::vec3 force;
 	bool fixed = false;
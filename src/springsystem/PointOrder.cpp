@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include "PointOrder.h"
+
+PointOrder parsePointOrder(const std::string &name){
+	if(name == "row") return PointOrder::ROW;
+	if(name == "morton") return PointOrder::MORTON;
+	if(name == "hilbert") return PointOrder::HILBERT;
+
+	throw std::runtime_error("unknown point order: " + name);
+}
+
+const char* pointOrderName(PointOrder order){
+	switch(order){
+		case PointOrder::MORTON:
+			return "morton";
+		case PointOrder::HILBERT:
+			return "hilbert";
+		default:
+			return "row";
+	}
+}
+
+static uint64_t mortonKey(uint32_t x, uint32_t y){
+	uint64_t key = 0;
+
+	for(int bit = 0; bit < 32; bit++){
+		key |= (uint64_t) ((x >> bit) & 1) << (2 * bit + 1);
+		key |= (uint64_t) ((y >> bit) & 1) << (2 * bit);
+	}
+
+	return key;
+}
+
+/**
+ * Distance along the Hilbert curve filling a side x side square, side being a power of two.
+ */
+static uint64_t hilbertKey(uint32_t side, uint32_t x, uint32_t y){
+	uint64_t key = 0;
+
+	for(uint32_t s = side / 2; s > 0; s /= 2){
+		uint32_t rx = (x & s) > 0;
+		uint32_t ry = (y & s) > 0;
+
+		key += (uint64_t) s * s * ((3 * rx) ^ ry);
+
+		// Rotate the quadrant so the curve continues in the same orientation
+		if(ry == 0){
+			if(rx == 1){
+				x = side - 1 - x;
+				y = side - 1 - y;
+			}
+
+			std::swap(x, y);
+		}
+	}
+
+	return key;
+}
+
+/**
+ * Grids whose side isn't a power of two are placed in the smallest power of two square, the curve then simply skips
+ * the cells outside of the grid.
+ */
+std::vector<uint32_t> curveOrder(unsigned n, PointOrder order){
+	std::vector<uint32_t> rank(n * n);
+	std::iota(rank.begin(), rank.end(), 0);
+
+	if(order == PointOrder::ROW) return rank;
+
+	uint32_t side = 1;
+	while(side < n) side *= 2;
+
+	std::vector<uint64_t> keys(n * n);
+	for(uint32_t i = 0; i < n; i++){
+		for(uint32_t j = 0; j < n; j++){
+			keys[i * n + j] = order == PointOrder::MORTON ? mortonKey(i, j) : hilbertKey(side, i, j);
+		}
+	}
+
+	std::vector<uint32_t> cells(n * n);
+	std::iota(cells.begin(), cells.end(), 0);
+	std::sort(cells.begin(), cells.end(), [&keys](uint32_t a, uint32_t b){ return keys[a] < keys[b]; });
+
+	for(uint32_t k = 0; k < cells.size(); k++){
+		rank[cells[k]] = k;
+	}
+
+	return rank;
+}
@@ -0,0 +1,22 @@
+#ifndef VULK_POINTORDER_H
+#define VULK_POINTORDER_H
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class PointOrder {
+	ROW,
+	MORTON,
+	HILBERT
+};
+
+PointOrder parsePointOrder(const std::string &name);
+const char* pointOrderName(PointOrder order);
+
+// Position of every point of an n x n grid (indexed i * n + j) along the given curve
+std::vector<uint32_t> curveOrder(unsigned n, PointOrder order);
+
+
+#endif //VULK_POINTORDER_H
@@ -0,0 +1,19 @@
+#ifndef VULK_SIMULATIONPARAMETERS_H
+#define VULK_SIMULATIONPARAMETERS_H
+
+
+#define DEFAULT_DAMPING 3.0f
+
+/**
+ * Tunable constants of the cloth, taken by every spring system when it's constructed.
+ */
+struct SimulationParameters {
+	float k1 = 500000; // structural springs
+	float k2 = 500000; // shear springs
+	float k3 = 500; // bend springs
+	float mass = 0; // of the whole cloth, 0 keeps the mass given by the scene
+	float damping = DEFAULT_DAMPING;
+};
+
+
+#endif //VULK_SIMULATIONPARAMETERS_H
@@ -1,28 +1,41 @@
 #include "Spring.h"
 
-Spring::Spring(uint16_t a, uint16_t b, float k) : k(k), pointsIndexes(a, b){
+Spring::Spring(uint32_t a, uint32_t b, float k) : k(k), pointsIndexes(a, b){
 
 }
 
 void Spring::update(double time){
-	glm::vec3 posa = points.first->getPosition() * system->object->scale;
-	glm::vec3 posb = points.second->getPosition() * system->object->scale;
+	glm::vec3 force = getForce();
+
+	points.first->addForce(force);
+	points.second->addForce(-force);
+}
+
+/**
+ * Force on the first point, the second one gets the opposite.
+ */
+glm::vec3 Spring::getForce() const{
+	glm::vec3 posa = points.first->getPosition() * system->object->getScale();
+	glm::vec3 posb = points.second->getPosition() * system->object->getScale();
 
 	glm::vec3 direction = posa - posb;
-	//direction = glm::cross(direction, system->object->scale);
+	//direction = glm::cross(direction, system->object->getScale());
 
 	double currentLength = glm::length(direction);
 	double force = -k * (currentLength - length);
 
 	direction = glm::normalize(direction);
 
-	points.first->addForce(direction * (float) (force / 2.0));
-	points.second->addForce(direction * (float) (force / -2.0));
+	return direction * (float) (force / 2.0);
+}
+
+float Spring::getCurrentLength() const{
+	return glm::length((points.first->getPosition() - points.second->getPosition()) * system->object->getScale());
 }
 
 void Spring::updateVertices(){
-	vertices[0].pos = points.first->getPosition() * system->object->scale + system->object->position;
-	vertices[1].pos = points.second->getPosition() * system->object->scale + system->object->position;
+	vertices[0].pos = points.first->getPosition() * system->object->getScale() + system->object->getPosition();
+	vertices[1].pos = points.second->getPosition() * system->object->getScale() + system->object->getPosition();
 }
 
 void Spring::setSystem(SpringSystem *system){
@@ -33,20 +46,14 @@ void Spring::setSystem(SpringSystem *system){
 
 	points = { a, b };
 
-	glm::vec3 posa = a->getPosition() * system->object->scale + system->object->position;
-	glm::vec3 posb = b->getPosition() * system->object->scale + system->object->position;
-
-	Vertex va = { posa };
-	Vertex vb = { posb };
-
-	va.color.b = vb.color.b = 1.0;
+	glm::vec3 posa = a->getPosition() * system->object->getScale() + system->object->getPosition();
+	glm::vec3 posb = b->getPosition() * system->object->getScale() + system->object->getPosition();
 
-	vertices.push_back(va);
-	vertices.push_back(vb);
+	vertices = { LineVertex(posa, { 0, 0, 1 }), LineVertex(posb, { 0, 0, 1 }) };
 
 	length = glm::length(a->getPosition() - b->getPosition());
 }
 
-const std::pair<uint16_t, uint16_t>& Spring::getIndexes() const{
+const std::pair<uint32_t, uint32_t>& Spring::getIndexes() const{
 	return pointsIndexes;
 }
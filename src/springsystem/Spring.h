@@ -2,10 +2,12 @@
 #define VULK_SPRING_H
 
 
+#include <array>
 #include <utility>
 #include "../interfaces/ITimeBound.h"
 #include "MassPoint.h"
 #include "../graphics/BufferAllocation.h"
+#include "../storage/ComponentRegistry.h"
 #include "../graphics/Vulkan.h"
 #include "SpringSystem.h"
 
@@ -13,26 +15,30 @@ class SpringSystem;
 
 class Spring : public ITimeBound {
 public:
-	Spring(uint16_t a, uint16_t b, float k);
+	Spring(uint32_t a, uint32_t b, float k);
 
 	BufferAllocation *vertexBuffer = nullptr;
-	std::vector<Vertex> vertices;
+	std::array<LineVertex, 2> vertices;
 
 	void update(double time) override;
+	glm::vec3 getForce() const;
+	float getCurrentLength() const;
 
 	void updateVertices();
 
 	void setSystem(SpringSystem *system);
 
-	const std::pair<uint16_t, uint16_t>& getIndexes() const;
+	const std::pair<uint32_t, uint32_t>& getIndexes() const;
 
 	float k;
 	float length;
 
+	Handle handle;
+
 
 private:
 	SpringSystem* system;
-	std::pair<uint16_t, uint16_t> pointsIndexes;
+	std::pair<uint32_t, uint32_t> pointsIndexes;
 	std::pair<MassPoint*, MassPoint*> points;
 };
 
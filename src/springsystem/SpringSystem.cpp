@@ -1,67 +1,173 @@
+#include <algorithm>
 #include "SpringSystem.h"
 #include "../Game.h"
 #include "../storage/Storage.h"
-#include "../Game.h"
+#include "../data.h"
+
+// Points or springs handed to a thread at a time
+#define PARALLEL_BLOCK 1024
+
+// Sleeping, see SpringSystem::Tile
+#define SLEEP_TILE 8
+#define SLEEP_STEPS 200
+#define SLEEP_VELOCITY 0.01f
+#define WAKE_VELOCITY 0.05f
 
-SpringSystem::SpringSystem(WorldObject *object, unsigned n, float mass) : object(object), n(n){
-	Storage::sSystems.push_back(this);
+SpringSystem::SpringSystem(WorldObject *object, unsigned n, float mass) : object(object),
+		surface(&object->renderComponent->mesh), gpu(gpuCloth), n(n),
+		mass(simulationParameters.mass > 0 ? simulationParameters.mass : mass), parameters(simulationParameters){
+	handle = Storage::sSystems.add(this);
 	PhysicsEngine::physComps.push_back(this);
 
-	constructPoints(mass / pow(n, 2));
+	order = curveOrder(n, pointOrder);
+	if(pointOrder != PointOrder::ROW) reorderMesh();
+
+	constructPoints(SpringSystem::mass / pow(n, 2));
+	constructSprings();
+
+	if(pointOrder != PointOrder::ROW) sortSprings();
+	if(clothSleep && !gpu) buildTiles();
+}
+
+/**
+ * Spring system loaded from a scene file, the mesh is already in the stored point order and the springs come with
+ * their rest lengths. Stored spring constants are kept, only the mass and damping come from the parameters.
+ */
+SpringSystem::SpringSystem(WorldObject *object, unsigned n, float mass, const std::vector<uint32_t> &order,
+						   ArrayView<SceneSpring> springs) : object(object), surface(&object->renderComponent->mesh), gpu(gpuCloth), n(n),
+						   mass(simulationParameters.mass > 0 ? simulationParameters.mass : mass), parameters(simulationParameters), order(order){
+	handle = Storage::sSystems.add(this);
+	PhysicsEngine::physComps.push_back(this);
+
+	constructPoints(SpringSystem::mass / pow(n, 2));
+
+	Storage::pool<Spring>().reserve(springs.size);
+	SpringSystem::springs.reserve(springs.size);
+
+	for(const SceneSpring& s : springs){
+		if(s.first >= points.size() || s.second >= points.size()){
+			throw std::runtime_error("spring references a point outside of the system!");
+		}
+
+		Spring* spring = Storage::create<Spring>(s.first, s.second, s.k);
+		addSpring(spring);
+		spring->length = s.length;
+	}
+
+	if(clothSleep && !gpu) buildTiles();
+}
+
+/**
+ * Coarser level of a cloth, simulated on its own grid of vertices. It isn't registered anywhere, the owning ClothLOD
+ * decides when it runs.
+ */
+SpringSystem::SpringSystem(WorldObject *object, Mesh *surface, unsigned n, float mass) : object(object), surface(surface),
+		detached(true), n(n), mass(simulationParameters.mass > 0 ? simulationParameters.mass : mass), parameters(simulationParameters){
+	order = curveOrder(n, pointOrder);
+	if(pointOrder != PointOrder::ROW) reorderMesh();
+
+	constructPoints(SpringSystem::mass / pow(n, 2));
 	constructSprings();
+
+	if(pointOrder != PointOrder::ROW) sortSprings();
+	if(clothSleep && !gpu) buildTiles();
+}
+
+/**
+ * Moves the vertices of the cloth to their place along the space-filling curve, so points that are close on the grid
+ * (and the springs between them) are also close in memory.
+ */
+void SpringSystem::reorderMesh(){
+	Mesh& plane = *surface;
+
+	if(plane.vertices.size() != order.size()){
+		throw std::runtime_error("spring system mesh isn't an n x n grid!");
+	}
+
+	std::vector<Vertex> vertices(plane.vertices.size());
+	for(int k = 0; k < vertices.size(); k++){
+		vertices[order[k]] = plane.vertices[k];
+	}
+
+	plane.vertices = vertices;
+
+	for(uint32_t& index : plane.indices){
+		index = order[index];
+	}
+}
+
+void SpringSystem::sortSprings(){
+	std::stable_sort(springs.begin(), springs.end(), [](Spring* a, Spring* b){
+		const std::pair<uint32_t, uint32_t>& ia = a->getIndexes();
+		const std::pair<uint32_t, uint32_t>& ib = b->getIndexes();
+
+		return std::make_pair(std::min(ia.first, ia.second), std::max(ia.first, ia.second))
+			 < std::make_pair(std::min(ib.first, ib.second), std::max(ib.first, ib.second));
+	});
 }
 
 void SpringSystem::constructPoints(float mass){
 	points.resize(pow(n, 2));
 	mesh.resize(n);
 
+	Storage::pool<MassPoint>().reserve(points.size());
 	for(int i = 0; i < points.size(); i++){
-		points[i] = new MassPoint(&(object->renderComponent->mesh.vertices[i]), &object->renderComponent->transforms, mass);
+		points[i] = Storage::create<MassPoint>(&(surface->vertices[i]), mass);
+	}
 
-		int j = i / n;
-		mesh[j].push_back(points[i]);
+	for(unsigned i = 0; i < n; i++){
+		for(unsigned j = 0; j < n; j++){
+			mesh[i].push_back(points[index(i, j)]);
+		}
 	}
 }
 
+uint32_t SpringSystem::index(unsigned i, unsigned j) const{
+	return order[i * n + j];
+}
+
 void SpringSystem::constructSprings(){
-	float k1 = 500000;
-	float k2 = 500000;
-	float k3 = 500;
+	float k1 = parameters.k1;
+	float k2 = parameters.k2;
+	float k3 = parameters.k3;
+
+	// Structural, shear and bend springs, roughly six per point
+	Storage::pool<Spring>().reserve(6 * n * n);
 
 	for(int i = 0; i < mesh.size(); i++){
 		for(int j = 0; j < mesh[i].size(); j++){
 			if(i > 0){
 				//Spring* a = new Spring(points[i][j], points[i-1][j], k1);
-				Spring* a = new Spring(i * mesh.size() + j, (i-1) * mesh.size() + j, k1);
+				Spring* a = Storage::create<Spring>(index(i, j), index(i-1, j), k1);
 				addSpring(a);
 			}
 
 			if(j > 0){
 				//Spring* b = new Spring(points[i][j], points[i][j-1], k1);
-				Spring* b = new Spring(i * mesh.size() + j, i * mesh.size() + j - 1, k1);
+				Spring* b = Storage::create<Spring>(index(i, j), index(i, j - 1), k1);
 				addSpring(b);
 			}
 
 			if(j > 0 && i > 0){
-				Spring* b = new Spring((i-1) * mesh.size() + j, i * mesh.size() + j - 1, k2);
+				Spring* b = Storage::create<Spring>(index(i-1, j), index(i, j - 1), k2);
 				addSpring(b);
 			}
 
 			if(j > 0 && i < mesh.size()-1){
-				Spring* b = new Spring((i+1) * mesh.size() + j, i * mesh.size() + j - 1, k2);
+				Spring* b = Storage::create<Spring>(index(i+1, j), index(i, j - 1), k2);
 				addSpring(b);
 			}
 
 
 			if(i > 1){
 				//Spring* a = new Spring(points[i][j], points[i-1][j], k1);
-				Spring* a = new Spring(i * mesh.size() + j, (i-2) * mesh.size() + j, k3);
+				Spring* a = Storage::create<Spring>(index(i, j), index(i-2, j), k3);
 				addSpring(a);
 			}
 
 			if(j > 1){
 				//Spring* b = new Spring(points[i][j], points[i][j-1], k1);
-				Spring* b = new Spring(i * mesh.size() + j, i * mesh.size() + j - 2, k3);
+				Spring* b = Storage::create<Spring>(index(i, j), index(i, j - 2), k3);
 				addSpring(b);
 			}
 		}
@@ -69,27 +175,63 @@ void SpringSystem::constructSprings(){
 }
 
 void SpringSystem::resetForce(){
+	if(gpu) return;
+
 	for(int i = 0; i < points.size(); i++){
-		points[i]->resetForce();
+		if(isAwake(i)) points[i]->resetForce();
 	}
 }
 void SpringSystem::collide(CollisionComponent *collidor){
-	for(MassPoint* point : points){
-		glm::vec3 pos =  point->getPosition() * object->scale + object->position;
-		glm::vec3 diff = collidor->collide(pos);
-		//point->move(diff);
-		point->addVelocity(diff * 500.0f);
+	if(gpu) return;
+
+	// A collider close to a sleeping tile wakes it before the points are tested
+	if(!tiles.empty()){
+		glm::vec4 sphere = collidor->getSphere();
+
+		for(Tile& tile : tiles){
+			if(tile.asleep && glm::length(glm::vec3(sphere) - tile.center) < sphere.w + tile.radius){
+				wake(tile);
+			}
+		}
+	}
+
+	ThreadPool* pool = PhysicsEngine::threadPool;
+	auto collidePoints = [&](size_t begin, size_t end){
+		for(size_t i = begin; i < end; i++){
+			if(!isAwake(i)) continue;
+
+			MassPoint* point = points[i];
+			glm::vec3 pos =  point->getPosition() * object->getScale() + object->getPosition();
+			glm::vec3 diff = collidor->collide(pos);
+			//point->move(diff);
+			point->addVelocity(diff * 500.0f);
+		}
+	};
+
+	if(pool != nullptr){
+		pool->parallelFor(points.size(), PARALLEL_BLOCK, collidePoints);
+	}else{
+		collidePoints(0, points.size());
 	}
 }
 
 void SpringSystem::update(double time){
+	if(gpu) return;
 
-	for(Spring* spring : springs){
-		spring->update(time);
+	if(PhysicsEngine::threadPool != nullptr){
+		updateParallel(time, *PhysicsEngine::threadPool);
+	}else{
+		for(Spring* spring : springs){
+			if(isActive(spring)) spring->update(time);
+		}
+
+		for(int i = 0; i < points.size(); i++){
+			if(isAwake(i)) points[i]->update(time, parameters.damping);
+		}
 	}
 
-	for(int i = 0; i < points.size(); i++){
-		points[i]->update(time);
+	if(!tiles.empty()){
+		updateSleep();
 	}
 
 	if(drawMesh){
@@ -99,12 +241,214 @@ void SpringSystem::update(double time){
 	}
 }
 
+/**
+ * Spring forces are computed first, then every point sums the forces of its springs in the same order the serial loop
+ * adds them in. The result doesn't depend on the number of threads and matches the serial solver bit for bit.
+ */
+void SpringSystem::updateParallel(double time, ThreadPool &pool){
+	if(springForces.size() != springs.size()){
+		pointSprings = getPointSprings();
+		springForces.resize(springs.size());
+	}
+
+	pool.parallelFor(springs.size(), PARALLEL_BLOCK, [&](size_t begin, size_t end){
+		for(size_t i = begin; i < end; i++){
+			if(isActive(springs[i])) springForces[i] = springs[i]->getForce();
+		}
+	});
+
+	pool.parallelFor(points.size(), PARALLEL_BLOCK, [&](size_t begin, size_t end){
+		for(size_t i = begin; i < end; i++){
+			if(!isAwake(i)) continue;
+
+			for(uint32_t s = pointSprings[i]; s < pointSprings[i + 1]; s++){
+				uint32_t entry = pointSprings[s];
+				points[i]->addForce((entry & 1) == 0 ? springForces[entry >> 1] : -springForces[entry >> 1]);
+			}
+
+			points[i]->update(time, parameters.damping);
+		}
+	});
+}
+
+bool SpringSystem::isAwake(uint32_t point) const{
+	return pointAwake.empty() || pointAwake[point];
+}
+
+bool SpringSystem::isActive(const Spring *spring) const{
+	return isAwake(spring->getIndexes().first) || isAwake(spring->getIndexes().second);
+}
+
+void SpringSystem::buildTiles(){
+	unsigned count = (n + SLEEP_TILE - 1) / SLEEP_TILE;
+	tiles.resize(count * count);
+
+	for(unsigned i = 0; i < n; i++){
+		for(unsigned j = 0; j < n; j++){
+			tiles[(i / SLEEP_TILE) * count + j / SLEEP_TILE].points.push_back(index(i, j));
+		}
+	}
+
+	std::vector<uint32_t> pointTile(points.size());
+
+	for(unsigned ti = 0; ti < count; ti++){
+		for(unsigned tj = 0; tj < count; tj++){
+			Tile& tile = tiles[ti * count + tj];
+			std::sort(tile.points.begin(), tile.points.end());
+
+			for(uint32_t point : tile.points){
+				pointTile[point] = ti * count + tj;
+			}
+
+			for(int di = -1; di <= 1; di++){
+				for(int dj = -1; dj <= 1; dj++){
+					int ni = ti + di, nj = tj + dj;
+					if((di != 0 || dj != 0) && ni >= 0 && nj >= 0 && ni < count && nj < count){
+						tile.neighbours.push_back(ni * count + nj);
+					}
+				}
+			}
+		}
+	}
+
+	const std::vector<uint32_t>& indices = surface->indices;
+	for(uint32_t i = 0; i + 2 < indices.size(); i += 3){
+		for(int k = 0; k < 3; k++){
+			std::vector<uint32_t>& triangles = tiles[pointTile[indices[i + k]]].triangles;
+			if(triangles.empty() || triangles.back() != i) triangles.push_back(i);
+		}
+	}
+
+	pointAwake.assign(points.size(), 1);
+}
+
+/**
+ * Runs after the points moved, puts quiet tiles to sleep and wakes the neighbours of fast ones.
+ */
+void SpringSystem::updateSleep(){
+	for(Tile& tile : tiles){
+		if(tile.asleep) continue;
+
+		tile.moved = true;
+
+		float maxVelocity = 0;
+		for(uint32_t point : tile.points){
+			const glm::vec3& velocity = points[point]->getVelocity();
+			maxVelocity = std::max(maxVelocity, glm::dot(velocity, velocity));
+		}
+
+		if(maxVelocity > WAKE_VELOCITY * WAKE_VELOCITY){
+			for(uint32_t neighbour : tile.neighbours){
+				if(tiles[neighbour].asleep) wake(tiles[neighbour]);
+			}
+		}
+
+		tile.quietSteps = maxVelocity < SLEEP_VELOCITY * SLEEP_VELOCITY ? tile.quietSteps + 1 : 0;
+		if(tile.quietSteps >= SLEEP_STEPS){
+			sleep(tile);
+		}
+	}
+}
+
+void SpringSystem::sleep(Tile &tile){
+	glm::vec3 min(INFINITY), max(-INFINITY);
+
+	for(uint32_t point : tile.points){
+		points[point]->setVelocity(glm::vec3(0));
+		pointAwake[point] = 0;
+
+		glm::vec3 pos = points[point]->getPosition() * object->getScale() + object->getPosition();
+		min = glm::min(min, pos);
+		max = glm::max(max, pos);
+	}
+
+	tile.center = (min + max) * 0.5f;
+	tile.radius = glm::length(max - min) * 0.5f;
+	tile.asleep = true;
+}
+
+void SpringSystem::wake(Tile &tile){
+	for(uint32_t point : tile.points){
+		pointAwake[point] = 1;
+		points[point]->resetForce();
+	}
+
+	tile.asleep = false;
+	tile.quietSteps = 0;
+	tile.moved = true;
+}
+
+/**
+ * Wakes the whole cloth, for when its points were moved from the outside (checkpoints, playback, level changes).
+ */
+void SpringSystem::wakeAll(){
+	for(Tile& tile : tiles){
+		if(tile.asleep) wake(tile);
+		tile.moved = true;
+	}
+}
+
+float SpringSystem::getSleepingFraction() const{
+	if(pointAwake.empty()) return 0;
+
+	return 1.0f - std::count(pointAwake.begin(), pointAwake.end(), 1) / (float) pointAwake.size();
+}
+
+/**
+ * Ranges of vertices that have to be uploaded again: the tiles that moved since the last call and their neighbours,
+ * whose normals depend on them. Empty when the whole cloth slept through. The triangles touching the ranges, which
+ * their normals are recomputed from, go to triangles.
+ */
+std::vector<std::pair<uint32_t, uint32_t>> SpringSystem::takeMovedRanges(std::vector<uint32_t> &triangles){
+	triangles.clear();
+
+	if(tiles.empty()){
+		for(uint32_t i = 0; i + 2 < surface->indices.size(); i += 3){
+			triangles.push_back(i);
+		}
+
+		return { { 0, (uint32_t) points.size() } };
+	}
+
+	std::vector<uint8_t> upload(tiles.size(), 0);
+	for(uint32_t t = 0; t < tiles.size(); t++){
+		if(!tiles[t].moved) continue;
+
+		upload[t] = 1;
+		for(uint32_t neighbour : tiles[t].neighbours){
+			upload[neighbour] = 1;
+		}
+
+		tiles[t].moved = false;
+	}
+
+	std::vector<uint32_t> vertices;
+	for(uint32_t t = 0; t < tiles.size(); t++){
+		if(!upload[t]) continue;
+
+		vertices.insert(vertices.end(), tiles[t].points.begin(), tiles[t].points.end());
+		triangles.insert(triangles.end(), tiles[t].triangles.begin(), tiles[t].triangles.end());
+	}
+
+	std::sort(vertices.begin(), vertices.end());
+
+	// Triangles across a tile border are listed by every tile they touch
+	std::sort(triangles.begin(), triangles.end());
+	triangles.erase(std::unique(triangles.begin(), triangles.end()), triangles.end());
+
+	std::vector<std::pair<uint32_t, uint32_t>> ranges;
+	for(uint32_t vertex : vertices){
+		if(!ranges.empty() && ranges.back().second == vertex) ranges.back().second++;
+		else ranges.emplace_back(vertex, vertex + 1);
+	}
+
+	return ranges;
+}
+
 void SpringSystem::addSpring(Spring* spring){
-	Storage::springs.push_back(spring);
+	if(!detached) spring->handle = Storage::springs.add(spring);
 	springs.push_back(spring);
 	spring->setSystem(this);
-
-	std::pair<uint16_t, uint16_t> indexes = spring->getIndexes();
 }
 
 void SpringSystem::addPoint(MassPoint* point){
@@ -128,15 +472,114 @@ int SpringSystem::getNoPoints(){
 }
 
 void SpringSystem::setFixed(int i, int j, bool fixed){
-	points[i * n + j]->setFixed(fixed);
+	points[index(i, j)]->setFixed(fixed);
 }
 
-void SpringSystem::cleanup(){
-	for(MassPoint* mp : points){
-		delete mp;
+const std::vector<Spring*>& SpringSystem::getSprings() const{
+	return springs;
+}
+
+const std::vector<uint32_t>& SpringSystem::getOrder() const{
+	return order;
+}
+
+unsigned SpringSystem::getN() const{
+	return n;
+}
+
+float SpringSystem::getMass() const{
+	return mass;
+}
+
+std::vector<glm::uvec4> SpringSystem::getNeighbours() const{
+	std::vector<glm::uvec4> neighbours(points.size());
+
+	for(unsigned i = 0; i < n; i++){
+		for(unsigned j = 0; j < n; j++){
+			neighbours[index(i, j)] = {
+					index(i > 0 ? i-1 : i, j),
+					index(i < n-1 ? i+1 : i, j),
+					index(i, j > 0 ? j-1 : j),
+					index(i, j < n-1 ? j+1 : j)
+			};
+		}
 	}
 
-	for(Spring* mp : springs){
-		delete mp;
+	return neighbours;
+}
+
+/**
+ * Offsets of every point's list of springs, followed by the lists themselves. Entries are (spring << 1 | isSecond), in
+ * the order of the springs.
+ */
+std::vector<uint32_t> SpringSystem::getPointSprings() const{
+	std::vector<uint32_t> pointSprings(points.size() + 1, 0);
+
+	for(Spring* spring : springs){
+		pointSprings[spring->getIndexes().first + 1]++;
+		pointSprings[spring->getIndexes().second + 1]++;
 	}
+
+	pointSprings[0] = points.size() + 1;
+	for(int i = 1; i < pointSprings.size(); i++){
+		pointSprings[i] += pointSprings[i-1];
+	}
+
+	std::vector<uint32_t> fill(pointSprings.begin(), pointSprings.end() - 1);
+	pointSprings.resize(pointSprings.back());
+
+	for(uint32_t i = 0; i < springs.size(); i++){
+		pointSprings[fill[springs[i]->getIndexes().first]++] = i << 1;
+		pointSprings[fill[springs[i]->getIndexes().second]++] = (i << 1) | 1;
+	}
+
+	return pointSprings;
+}
+
+const SimulationParameters& SpringSystem::getParameters() const{
+	return parameters;
+}
+
+/**
+ * Largest relative deviation of a spring from its rest length.
+ */
+float SpringSystem::getMaxStretch() const{
+	float stretch = 0;
+
+	for(Spring* spring : springs){
+		if(spring->length > 0) stretch = std::max(stretch, std::abs(spring->getCurrentLength() / spring->length - 1));
+	}
+
+	return stretch;
+}
+
+/**
+ * Kinetic, gravitational and spring energy of the cloth. Each end of a spring gets half of its force, so a spring acts
+ * with the stiffness k / 2.
+ */
+double SpringSystem::getEnergy() const{
+	double energy = 0;
+
+	for(MassPoint* point : points){
+		glm::vec3 velocity = point->getVelocity() * object->getScale();
+		float height = point->getPosition().z * object->getScale().z + object->getPosition().z;
+
+		energy += 0.5 * point->getMass() * glm::dot(velocity, velocity);
+		energy += point->getMass() * 9.81 * height;
+	}
+
+	for(Spring* spring : springs){
+		double extension = spring->getCurrentLength() - spring->length;
+		energy += 0.25 * spring->k * extension * extension;
+	}
+
+	return energy;
+}
+
+void SpringSystem::cleanup(){
+	// Points and springs are owned by the Storage pools
+	points.clear();
+	springs.clear();
+	pointSprings.clear();
+	springForces.clear();
 }
@@ -4,14 +4,22 @@
 
 #include <vector>
 #include "Spring.h"
+#include "PointOrder.h"
+#include "SimulationParameters.h"
+#include "../storage/ComponentRegistry.h"
+#include "../storage/SceneFile.h"
 #include "../physics/IPhysicsComponent.h"
+#include "../physics/ThreadPool.h"
 
 class Spring;
 class WorldObject;
+class ClothRefinement;
 
 class SpringSystem : public IPhysicsComponent {
 public:
 	SpringSystem(WorldObject *object, unsigned n, float mass);
+	SpringSystem(WorldObject *object, unsigned n, float mass, const std::vector<uint32_t> &order, ArrayView<SceneSpring> springs);
+	SpringSystem(WorldObject *object, Mesh *surface, unsigned n, float mass);
 
 	void update(double time) override;
 	void resetForce() override;
@@ -25,15 +33,87 @@ public:
 	MassPoint* getPoint(int n);
 	void setFixed(int i, int j, bool fixed);
 
+	const std::vector<Spring*>& getSprings() const;
+	const std::vector<uint32_t>& getOrder() const;
+	unsigned getN() const;
+	float getMass() const;
+	std::vector<glm::uvec4> getNeighbours() const;
+	std::vector<uint32_t> getPointSprings() const;
+	const SimulationParameters& getParameters() const;
+
+	float getMaxStretch() const;
+	double getEnergy() const;
+
+	float getSleepingFraction() const;
+	void wakeAll();
+	std::vector<std::pair<uint32_t, uint32_t>> takeMovedRanges(std::vector<uint32_t> &triangles);
+
 	void cleanup();
 
 	WorldObject* object;
+	Handle handle;
+
+	// Mesh the points move, the object's render mesh unless the system is a level of a ClothLOD or refined
+	Mesh* surface;
+	bool detached = false;
+
+	// Builds the render mesh from the points when the cloth is rendered finer than it is simulated
+	ClothRefinement* refinement = nullptr;
+
+	// Simulated by the compute shader instead of the processor
+	bool gpu = false;
+	BufferAllocation *pointBuffer = nullptr;
+	BufferAllocation *springBuffer = nullptr;
+	BufferAllocation *pointSpringBuffer = nullptr;
+	BufferAllocation *neighbourBuffer = nullptr;
+	VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+
 private:
 	unsigned n;
+	float mass;
+	SimulationParameters parameters;
 
+	// Storage index of every grid point, see PointOrder
+	std::vector<uint32_t> order;
+	uint32_t index(unsigned i, unsigned j) const;
+
+	void reorderMesh();
+	void sortSprings();
 	void constructPoints(float mass);
 	void constructSprings();
 
+	void updateParallel(double time, ThreadPool &pool);
+
+	/*
+	 * Square tiles of the grid that fall asleep once their points stay slower than SLEEP_VELOCITY for SLEEP_STEPS
+	 * steps. Sleeping points aren't collided or integrated, springs between two of them aren't computed. A tile wakes
+	 * when a collider gets close or a neighbouring tile moves faster than WAKE_VELOCITY.
+	 */
+	struct Tile {
+		std::vector<uint32_t> points;
+		std::vector<uint32_t> neighbours;
+		std::vector<uint32_t> triangles; // first index of the surface triangles touching the points
+		glm::vec3 center;
+		float radius = 0;
+		int quietSteps = 0;
+		bool asleep = false;
+		bool moved = true; // since the last upload
+	};
+
+	std::vector<Tile> tiles;
+	std::vector<uint8_t> pointAwake;
+
+	void buildTiles();
+	void updateSleep();
+	void sleep(Tile &tile);
+	void wake(Tile &tile);
+	bool isAwake(uint32_t point) const;
+	bool isActive(const Spring* spring) const;
+
+	// Per point spring lists and the spring forces of the current step, used by the parallel solver
+	std::vector<uint32_t> pointSprings;
+	std::vector<glm::vec3> springForces;
+
 	std::vector<MassPoint*> points;
 	std::vector<Spring*> springs;
 	std::vector<std::vector<MassPoint*>> mesh;
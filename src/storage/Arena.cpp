@@ -0,0 +1,71 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include "Arena.h"
+
+Arena::Arena(size_t chunkSize) : chunkSize(chunkSize){ }
+
+Arena::~Arena(){
+	release();
+}
+
+void* Arena::allocate(size_t size, size_t alignment){
+	while(current < chunks.size()){
+		Chunk& chunk = chunks[current];
+
+		uintptr_t base = reinterpret_cast<uintptr_t>(chunk.data);
+		size_t start = ((base + offset + alignment - 1) & ~(uintptr_t) (alignment - 1)) - base;
+
+		if(start + size <= chunk.size){
+			offset = start + size;
+			used += size;
+			return chunk.data + start;
+		}
+
+		current++;
+		offset = 0;
+	}
+
+	// Allocations bigger than a chunk get a chunk of their own
+	size_t bytes = std::max(chunkSize, size + alignment);
+	char* data = static_cast<char*>(std::malloc(bytes));
+	if(data == nullptr){
+		throw std::bad_alloc();
+	}
+
+	chunks.push_back({ data, bytes });
+	current = chunks.size() - 1;
+	offset = 0;
+
+	return allocate(size, alignment);
+}
+
+void Arena::reset(){
+	current = 0;
+	offset = 0;
+	used = 0;
+}
+
+void Arena::release(){
+	for(Chunk& chunk : chunks){
+		std::free(chunk.data);
+	}
+
+	chunks.clear();
+	reset();
+}
+
+size_t Arena::getUsed() const{
+	return used;
+}
+
+size_t Arena::getReserved() const{
+	size_t reserved = 0;
+
+	for(const Chunk& chunk : chunks){
+		reserved += chunk.size;
+	}
+
+	return reserved;
+}
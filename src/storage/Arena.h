@@ -0,0 +1,41 @@
+#ifndef VULK_ARENA_H
+#define VULK_ARENA_H
+
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Bump allocator for everything a scene creates. Memory is handed out from large chunks and is never freed on its own,
+ * reset() releases all of it at once (the chunks are kept for the next scene).
+ */
+class Arena {
+public:
+	explicit Arena(size_t chunkSize = 1 << 20);
+	~Arena();
+
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	void* allocate(size_t size, size_t alignment);
+	void reset();
+	void release();
+
+	size_t getUsed() const;
+	size_t getReserved() const;
+
+private:
+	struct Chunk {
+		char* data;
+		size_t size;
+	};
+
+	size_t chunkSize;
+	std::vector<Chunk> chunks;
+	size_t current = 0;
+	size_t offset = 0;
+	size_t used = 0;
+};
+
+
+#endif //VULK_ARENA_H
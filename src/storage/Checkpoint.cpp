@@ -0,0 +1,164 @@
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include "Checkpoint.h"
+#include "Storage.h"
+#include "../curves/CosLine.h"
+#include "../springsystem/ClothLOD.h"
+#include "../physics/PhysicsEngine.h"
+
+void Checkpoint::write(const std::string &filename, const PhysicsEngine &physics){
+	std::vector<char> file(sizeof(CheckpointHeader));
+
+	// Only the full resolution systems are stored, a coarser level runs ahead of them
+	for(ClothLOD* lod : Storage::clothLods){
+		lod->switchToFull();
+	}
+
+	std::unordered_map<WorldObject*, uint32_t> indexes;
+	std::vector<CheckpointObject> objects;
+	std::vector<CheckpointModifier> modifiers;
+
+	for(uint32_t i = 0; i < Storage::worldObjects.size(); i++){
+		WorldObject* wObj = Storage::worldObjects[i];
+		indexes[wObj] = i;
+
+		CheckpointObject object;
+		memcpy(object.position, &wObj->getPosition()[0], sizeof(object.position));
+		memcpy(object.scale, &wObj->getScale()[0], sizeof(object.scale));
+		object.rotation[0] = wObj->getRotation().x;
+		object.rotation[1] = wObj->getRotation().y;
+		object.rotation[2] = wObj->getRotation().z;
+		object.rotation[3] = wObj->getRotation().w;
+		objects.push_back(object);
+
+		const std::vector<IObjectModifier*>& objectModifiers = wObj->getModifiers();
+		for(uint32_t j = 0; j < objectModifiers.size(); j++){
+			CosLine* line = dynamic_cast<CosLine*>(objectModifiers[j]);
+			if(line != nullptr) modifiers.push_back({ i, j, line->getTotalTime(), 0 });
+		}
+	}
+
+	std::vector<CheckpointSystem> systems;
+
+	for(SpringSystem* system : Storage::sSystems){
+		std::vector<glm::vec3> positions(system->getNoPoints());
+		std::vector<glm::vec3> velocities(system->getNoPoints());
+		std::vector<uint8_t> fixed(system->getNoPoints());
+
+		for(int i = 0; i < system->getNoPoints(); i++){
+			MassPoint* point = system->getPoint(i);
+			positions[i] = point->getPosition();
+			velocities[i] = point->getVelocity();
+			fixed[i] = point->isFixed();
+		}
+
+		CheckpointSystem record;
+		record.object = indexes.at(system->object);
+		record.pointCount = system->getNoPoints();
+		record.positionOffset = appendAligned(file, positions.data(), positions.size() * sizeof(glm::vec3));
+		record.velocityOffset = appendAligned(file, velocities.data(), velocities.size() * sizeof(glm::vec3));
+		record.fixedOffset = appendAligned(file, fixed.data(), fixed.size());
+
+		systems.push_back(record);
+	}
+
+	CheckpointHeader header;
+	memset(&header, 0, sizeof(header));
+
+	header.magic = CHECKPOINT_MAGIC;
+	header.version = CHECKPOINT_VERSION;
+	header.objectCount = objects.size();
+	header.modifierCount = modifiers.size();
+	header.systemCount = systems.size();
+	header.timeResidue = physics.getTimeResidue();
+	header.objectsOffset = appendAligned(file, objects.data(), objects.size() * sizeof(CheckpointObject));
+	header.modifiersOffset = appendAligned(file, modifiers.data(), modifiers.size() * sizeof(CheckpointModifier));
+	header.systemsOffset = appendAligned(file, systems.data(), systems.size() * sizeof(CheckpointSystem));
+	header.fileSize = file.size();
+
+	memcpy(file.data(), &header, sizeof(header));
+
+	writeFile(filename, file);
+}
+
+/**
+ * Point state is read straight from the mapping into the mass points, nothing is buffered in between. Every array is
+ * checked before the first write, so a truncated file leaves the scene as it was.
+ */
+void Checkpoint::restore(const std::string &filename, PhysicsEngine &physics){
+	MappedFile file(filename);
+
+	const CheckpointHeader& header = file.at<CheckpointHeader>(0);
+	if(header.magic != CHECKPOINT_MAGIC || header.version != CHECKPOINT_VERSION || header.fileSize != file.getSize()){
+		throw std::runtime_error("unsupported checkpoint " + filename);
+	}
+
+	ArrayView<CheckpointObject> objects = file.array<CheckpointObject>(header.objectsOffset, header.objectCount);
+	ArrayView<CheckpointModifier> modifiers = file.array<CheckpointModifier>(header.modifiersOffset, header.modifierCount);
+	ArrayView<CheckpointSystem> systems = file.array<CheckpointSystem>(header.systemsOffset, header.systemCount);
+
+	if(objects.size != Storage::worldObjects.size() || systems.size != Storage::sSystems.size()){
+		throw std::runtime_error("checkpoint " + filename + " was taken in a different scene!");
+	}
+
+	struct SystemState {
+		ArrayView<glm::vec3> positions;
+		ArrayView<glm::vec3> velocities;
+		ArrayView<uint8_t> fixed;
+	};
+
+	std::vector<SystemState> states;
+	states.reserve(systems.size);
+
+	for(uint32_t i = 0; i < systems.size; i++){
+		if(systems[i].pointCount != Storage::sSystems[i]->getNoPoints()){
+			throw std::runtime_error("checkpoint " + filename + " was taken in a different scene!");
+		}
+
+		states.push_back({ file.array<glm::vec3>(systems[i].positionOffset, systems[i].pointCount),
+						   file.array<glm::vec3>(systems[i].velocityOffset, systems[i].pointCount),
+						   file.array<uint8_t>(systems[i].fixedOffset, systems[i].pointCount) });
+	}
+
+	// Otherwise the next frame would overwrite the restored points from the coarser level
+	for(ClothLOD* lod : Storage::clothLods){
+		lod->switchToFull();
+	}
+
+	for(uint32_t i = 0; i < objects.size; i++){
+		WorldObject* wObj = Storage::worldObjects[i];
+		const CheckpointObject& object = objects[i];
+
+		wObj->setPosition(glm::vec3(object.position[0], object.position[1], object.position[2]));
+		wObj->setRotation(glm::quat(object.rotation[3], object.rotation[0], object.rotation[1], object.rotation[2]));
+		wObj->setScale(glm::vec3(object.scale[0], object.scale[1], object.scale[2]));
+	}
+
+	for(const CheckpointModifier& modifier : modifiers){
+		if(modifier.object >= objects.size) continue;
+
+		const std::vector<IObjectModifier*>& objectModifiers = Storage::worldObjects[modifier.object]->getModifiers();
+		if(modifier.index >= objectModifiers.size()) continue;
+
+		CosLine* line = dynamic_cast<CosLine*>(objectModifiers[modifier.index]);
+		if(line != nullptr) line->setTotalTime(modifier.totalTime);
+	}
+
+	for(uint32_t i = 0; i < systems.size; i++){
+		SpringSystem* system = Storage::sSystems[i];
+		const SystemState& state = states[i];
+
+		for(uint32_t j = 0; j < systems[i].pointCount; j++){
+			MassPoint* point = system->getPoint(j);
+			point->setPosition(state.positions[j]);
+			point->setVelocity(state.velocities[j]);
+			point->setFixed(state.fixed[j] != 0);
+			point->resetForce();
+		}
+
+		system->wakeAll();
+	}
+
+	physics.setTimeResidue(header.timeResidue);
+}
@@ -0,0 +1,61 @@
+#ifndef VULK_CHECKPOINT_H
+#define VULK_CHECKPOINT_H
+
+
+#include <cstdint>
+#include <string>
+#include "MappedFile.h"
+
+#define CHECKPOINT_MAGIC 0x504b4356 // "VCKP"
+#define CHECKPOINT_VERSION 1
+
+class PhysicsEngine;
+
+/*
+ * Simulation state of the loaded scene, in the same plain record layout as the scene files. A checkpoint only stores
+ * what changes while simulating, it can be restored only into the scene it was taken from.
+ */
+
+struct CheckpointHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t objectCount;
+	uint32_t modifierCount;
+	uint32_t systemCount;
+	uint32_t reserved;
+	double timeResidue;
+	uint64_t objectsOffset;
+	uint64_t modifiersOffset;
+	uint64_t systemsOffset;
+	uint64_t fileSize;
+};
+
+struct CheckpointObject {
+	float position[3];
+	float rotation[4]; // x, y, z, w
+	float scale[3];
+};
+
+struct CheckpointModifier {
+	uint32_t object;
+	uint32_t index; // among the object's modifiers
+	float totalTime;
+	uint32_t reserved;
+};
+
+struct CheckpointSystem {
+	uint32_t object;
+	uint32_t pointCount;
+	uint64_t positionOffset; // float x, y, z per point
+	uint64_t velocityOffset; // float x, y, z per point
+	uint64_t fixedOffset; // one byte per point
+};
+
+class Checkpoint {
+public:
+	static void write(const std::string &filename, const PhysicsEngine &physics);
+	static void restore(const std::string &filename, PhysicsEngine &physics);
+};
+
+
+#endif //VULK_CHECKPOINT_H
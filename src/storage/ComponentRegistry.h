@@ -0,0 +1,115 @@
+#ifndef VULK_COMPONENTREGISTRY_H
+#define VULK_COMPONENTREGISTRY_H
+
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * Stable reference to a registered component. The generation is bumped every time a slot is freed, so a handle to a
+ * removed component is recognised as stale even after its slot is reused.
+ */
+struct Handle {
+	uint32_t slot = UINT32_MAX;
+	uint32_t generation = 0;
+};
+
+/**
+ * Dense array of components with O(1) add and remove. Components are kept packed so systems iterate over a contiguous
+ * array; removal swaps the last component into the freed place, which means the iteration order isn't preserved.
+ */
+template<typename T>
+class ComponentRegistry {
+public:
+	Handle add(T* component){
+		uint32_t slot;
+
+		if(!freeSlots.empty()){
+			slot = freeSlots.back();
+			freeSlots.pop_back();
+		}else{
+			slot = slots.size();
+			slots.push_back({ 0, 0 });
+		}
+
+		slots[slot].dense = dense.size();
+		dense.push_back(component);
+		denseSlots.push_back(slot);
+
+		return { slot, slots[slot].generation };
+	}
+
+	void remove(Handle handle){
+		if(!valid(handle)){
+			throw std::runtime_error("removing a component with a stale handle!");
+		}
+
+		uint32_t index = slots[handle.slot].dense;
+		uint32_t last = dense.size() - 1;
+
+		dense[index] = dense[last];
+		denseSlots[index] = denseSlots[last];
+		slots[denseSlots[index]].dense = index;
+
+		dense.pop_back();
+		denseSlots.pop_back();
+
+		slots[handle.slot].generation++;
+		freeSlots.push_back(handle.slot);
+	}
+
+	bool valid(Handle handle) const{
+		return handle.slot < slots.size() && slots[handle.slot].generation == handle.generation
+			   && slots[handle.slot].dense < dense.size() && denseSlots[slots[handle.slot].dense] == handle.slot;
+	}
+
+	T* get(Handle handle) const{
+		return valid(handle) ? dense[slots[handle.slot].dense] : nullptr;
+	}
+
+	void clear(){
+		for(uint32_t slot : denseSlots){
+			slots[slot].generation++;
+			freeSlots.push_back(slot);
+		}
+
+		dense.clear();
+		denseSlots.clear();
+	}
+
+	T* operator[](size_t i) const{
+		return dense[i];
+	}
+
+	size_t size() const{
+		return dense.size();
+	}
+
+	bool empty() const{
+		return dense.empty();
+	}
+
+	typename std::vector<T*>::const_iterator begin() const{
+		return dense.begin();
+	}
+
+	typename std::vector<T*>::const_iterator end() const{
+		return dense.end();
+	}
+
+private:
+	struct Slot {
+		uint32_t dense;
+		uint32_t generation;
+	};
+
+	std::vector<T*> dense;
+	std::vector<uint32_t> denseSlots;
+
+	std::vector<Slot> slots;
+	std::vector<uint32_t> freeSlots;
+};
+
+
+#endif //VULK_COMPONENTREGISTRY_H
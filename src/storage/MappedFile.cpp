@@ -0,0 +1,65 @@
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "MappedFile.h"
+
+MappedFile::MappedFile(const std::string &filename){
+	int fd = open(filename.c_str(), O_RDONLY);
+	if(fd < 0){
+		throw std::runtime_error("failed to open file " + filename);
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size == 0){
+		close(fd);
+		throw std::runtime_error("invalid file " + filename);
+	}
+
+	size = st.st_size;
+
+	void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if(mapping == MAP_FAILED){
+		throw std::runtime_error("failed to map file " + filename);
+	}
+
+	data = static_cast<const char*>(mapping);
+}
+
+MappedFile::~MappedFile(){
+	munmap(const_cast<char*>(data), size);
+}
+
+size_t MappedFile::getSize() const{
+	return size;
+}
+
+void MappedFile::check(uint64_t offset, uint64_t bytes, size_t alignment) const{
+	if(offset % alignment != 0 || offset > size || bytes > size - offset){
+		throw std::runtime_error("corrupt file!");
+	}
+}
+
+uint64_t appendAligned(std::vector<char> &file, const void* data, size_t bytes){
+	file.resize((file.size() + 15) & ~(size_t) 15);
+
+	uint64_t offset = file.size();
+	file.resize(file.size() + bytes);
+	if(bytes > 0) memcpy(file.data() + offset, data, bytes);
+
+	return offset;
+}
+
+void writeFile(const std::string &filename, const std::vector<char> &file){
+	std::ofstream out(filename, std::ios::binary);
+	if(!out.is_open()){
+		throw std::runtime_error("failed to open file " + filename);
+	}
+
+	out.write(file.data(), file.size());
+}
@@ -0,0 +1,61 @@
+#ifndef VULK_MAPPEDFILE_H
+#define VULK_MAPPEDFILE_H
+
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Read-only view of an array inside a mapped file.
+ */
+template<typename T>
+struct ArrayView {
+	const T* data = nullptr;
+	size_t size = 0;
+
+	const T* begin() const{ return data; }
+	const T* end() const{ return data + size; }
+	const T& operator[](size_t i) const{ return data[i]; }
+};
+
+/**
+ * Read-only memory mapping of a whole file, used by the binary scene and checkpoint formats.
+ */
+class MappedFile {
+public:
+	explicit MappedFile(const std::string &filename);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	size_t getSize() const;
+
+	template<typename T>
+	ArrayView<T> array(uint64_t offset, size_t count) const{
+		check(offset, count * sizeof(T), alignof(T));
+		return { reinterpret_cast<const T*>(data + offset), count };
+	}
+
+	template<typename T>
+	const T& at(uint64_t offset) const{
+		check(offset, sizeof(T), alignof(T));
+		return *reinterpret_cast<const T*>(data + offset);
+	}
+
+private:
+	const char* data = nullptr;
+	size_t size = 0;
+
+	void check(uint64_t offset, uint64_t bytes, size_t alignment) const;
+};
+
+// Appends an array to a file being built in memory at a 16 byte aligned offset, returns the offset
+uint64_t appendAligned(std::vector<char> &file, const void* data, size_t bytes);
+
+void writeFile(const std::string &filename, const std::vector<char> &file);
+
+
+#endif //VULK_MAPPEDFILE_H
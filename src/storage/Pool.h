@@ -0,0 +1,114 @@
+#ifndef VULK_POOL_H
+#define VULK_POOL_H
+
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "Arena.h"
+
+/**
+ * Typed pool on top of an arena. Objects are placed into blocks of consecutive slots, so components of the same type
+ * end up next to each other in memory. Released slots go to a free list and are reused by the next create() that isn't
+ * covered by a reserve(). clear() runs the remaining destructors and forgets the blocks (the memory itself is returned
+ * when the arena is reset).
+ */
+template<typename T>
+class Pool {
+public:
+	explicit Pool(Arena& arena, size_t blockSize = 64) : arena(arena), blockSize(blockSize){ }
+
+	Pool(const Pool&) = delete;
+	Pool& operator=(const Pool&) = delete;
+
+	// Makes sure the next count objects are placed into one block
+	void reserve(size_t count){
+		reserved = count;
+		if(end - next >= (ptrdiff_t) count) return;
+
+		next = static_cast<Slot*>(arena.allocate(std::max(count, blockSize) * sizeof(Slot), alignof(Slot)));
+		end = next + std::max(count, blockSize);
+	}
+
+	template<typename... Args>
+	T* create(Args&&... args){
+		Slot* slot;
+
+		if(reserved == 0 && freeSlots != nullptr){
+			slot = freeSlots;
+			freeSlots = slot->nextFree;
+		}else{
+			if(next == end) reserve(1);
+			if(reserved > 0) reserved--;
+
+			slot = next++;
+		}
+
+		T* object = new(slot->storage) T(std::forward<Args>(args)...);
+
+		if(!std::is_trivially_destructible<T>::value){
+			slot->index = objects.size();
+			objects.push_back(slot);
+		}
+
+		return object;
+	}
+
+	// Runs the destructor and frees the slot, the last live object takes its place in the destructor list
+	void destroy(T* object){
+		Slot* slot = toSlot(object);
+
+		if(!std::is_trivially_destructible<T>::value){
+			Slot* last = objects.back();
+			objects[slot->index] = last;
+			last->index = slot->index;
+			objects.pop_back();
+		}
+
+		object->~T();
+
+		slot->nextFree = freeSlots;
+		freeSlots = slot;
+	}
+
+	void clear(){
+		for(Slot* slot : objects){
+			reinterpret_cast<T*>(slot->storage)->~T();
+		}
+
+		objects.clear();
+		next = end = freeSlots = nullptr;
+		reserved = 0;
+	}
+
+private:
+	// Index in objects while the slot is live, next free slot once it is released
+	struct Slot {
+		union {
+			size_t index;
+			Slot* nextFree;
+		};
+		alignas(T) unsigned char storage[sizeof(T)];
+	};
+
+	static Slot* toSlot(T* object){
+		return reinterpret_cast<Slot*>(reinterpret_cast<unsigned char*>(object) - offsetof(Slot, storage));
+	}
+
+	Arena& arena;
+	size_t blockSize;
+
+	Slot* next = nullptr;
+	Slot* end = nullptr;
+	Slot* freeSlots = nullptr;
+	size_t reserved = 0;
+
+	// Live objects with a destructor to run
+	std::vector<Slot*> objects;
+};
+
+
+#endif //VULK_POOL_H
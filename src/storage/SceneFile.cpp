@@ -0,0 +1,151 @@
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include "SceneFile.h"
+#include "Storage.h"
+#include "../curves/CosLine.h"
+
+SceneFile::SceneFile(const std::string &filename) : file(filename){
+	if(file.getSize() < sizeof(SceneHeader)){
+		throw std::runtime_error("invalid scene file " + filename);
+	}
+
+	const SceneHeader& header = getHeader();
+	if(header.magic != SCENE_FILE_MAGIC || header.version != SCENE_FILE_VERSION || header.vertexSize != sizeof(Vertex)
+	   || header.fileSize != file.getSize()){
+		throw std::runtime_error("unsupported scene file " + filename);
+	}
+}
+
+const SceneHeader &SceneFile::getHeader() const{
+	return file.at<SceneHeader>(0);
+}
+
+ArrayView<SceneObject> SceneFile::getObjects() const{
+	return array<SceneObject>(getHeader().objectsOffset, getHeader().objectCount);
+}
+
+ArrayView<SceneModifier> SceneFile::getModifiers() const{
+	return array<SceneModifier>(getHeader().modifiersOffset, getHeader().modifierCount);
+}
+
+ArrayView<SceneSystem> SceneFile::getSystems() const{
+	return array<SceneSystem>(getHeader().systemsOffset, getHeader().systemCount);
+}
+
+void SceneFile::write(const std::string &filename){
+	std::vector<char> file(sizeof(SceneHeader));
+
+	std::unordered_map<WorldObject*, uint32_t> indexes;
+	for(uint32_t i = 0; i < Storage::worldObjects.size(); i++){
+		indexes[Storage::worldObjects[i]] = i;
+	}
+
+	std::vector<SceneObject> objects;
+	std::vector<SceneModifier> modifiers;
+
+	// Arrays of the cached meshes already written, later objects drawing the same mesh point to them
+	std::unordered_map<const Mesh*, std::pair<uint64_t, uint64_t>> sharedArrays;
+
+	for(uint32_t i = 0; i < Storage::worldObjects.size(); i++){
+		WorldObject* wObj = Storage::worldObjects[i];
+
+		SceneObject object;
+		memset(&object, 0, sizeof(object));
+
+		memcpy(object.position, &wObj->getPosition()[0], sizeof(object.position));
+		memcpy(object.scale, &wObj->getScale()[0], sizeof(object.scale));
+		object.rotation[0] = wObj->getRotation().x;
+		object.rotation[1] = wObj->getRotation().y;
+		object.rotation[2] = wObj->getRotation().z;
+		object.rotation[3] = wObj->getRotation().w;
+		object.parent = wObj->getParent() != nullptr ? (int32_t) indexes[wObj->getParent()] : -1;
+
+		if(wObj->collisionComponent != nullptr){
+			object.collisionRadius = wObj->collisionComponent->getSphere().w;
+		}
+
+		if(wObj->renderComponent != nullptr){
+			const Mesh& mesh = wObj->renderComponent->getMesh();
+
+			object.pipeline = wObj->renderComponent->pipeline;
+			object.vertexCount = mesh.vertices.size();
+			object.indexCount = mesh.indices.size();
+
+			auto shared = sharedArrays.find(&mesh);
+			if(shared != sharedArrays.end()){
+				object.vertexOffset = shared->second.first;
+				object.indexOffset = shared->second.second;
+			}else{
+				object.vertexOffset = appendAligned(file, mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+				object.indexOffset = appendAligned(file, mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+
+				if(wObj->renderComponent->sharedMesh) sharedArrays[&mesh] = { object.vertexOffset, object.indexOffset };
+			}
+		}
+
+		for(IObjectModifier* modifier : wObj->getModifiers()){
+			CosLine* line = dynamic_cast<CosLine*>(modifier);
+			if(line == nullptr) continue;
+
+			SceneModifier record;
+			memset(&record, 0, sizeof(record));
+
+			record.object = i;
+			record.type = SCENE_MODIFIER_COSLINE;
+			memcpy(record.influences, &line->getInfluences()[0], sizeof(record.influences));
+			record.amplitude = line->getAmplitude();
+			record.period = line->getPeriod();
+
+			modifiers.push_back(record);
+		}
+
+		objects.push_back(object);
+	}
+
+	std::vector<SceneSystem> systems;
+
+	for(SpringSystem* system : Storage::sSystems){
+		SceneSystem record;
+		memset(&record, 0, sizeof(record));
+
+		std::vector<SceneSpring> springs;
+		for(Spring* spring : system->getSprings()){
+			springs.push_back({ spring->getIndexes().first, spring->getIndexes().second, spring->k, spring->length });
+		}
+
+		std::vector<uint32_t> fixed;
+		for(uint32_t i = 0; i < system->getNoPoints(); i++){
+			if(system->getPoint(i)->isFixed()) fixed.push_back(i);
+		}
+
+		record.object = indexes[system->object];
+		record.n = system->getN();
+		record.mass = system->getMass();
+		record.springCount = springs.size();
+		record.fixedCount = fixed.size();
+		record.orderOffset = appendAligned(file, system->getOrder().data(), system->getOrder().size() * sizeof(uint32_t));
+		record.springOffset = appendAligned(file, springs.data(), springs.size() * sizeof(SceneSpring));
+		record.fixedOffset = appendAligned(file, fixed.data(), fixed.size() * sizeof(uint32_t));
+
+		systems.push_back(record);
+	}
+
+	SceneHeader header;
+	memset(&header, 0, sizeof(header));
+
+	header.magic = SCENE_FILE_MAGIC;
+	header.version = SCENE_FILE_VERSION;
+	header.vertexSize = sizeof(Vertex);
+	header.objectCount = objects.size();
+	header.modifierCount = modifiers.size();
+	header.systemCount = systems.size();
+	header.objectsOffset = appendAligned(file, objects.data(), objects.size() * sizeof(SceneObject));
+	header.modifiersOffset = appendAligned(file, modifiers.data(), modifiers.size() * sizeof(SceneModifier));
+	header.systemsOffset = appendAligned(file, systems.data(), systems.size() * sizeof(SceneSystem));
+	header.fileSize = file.size();
+
+	memcpy(file.data(), &header, sizeof(header));
+
+	writeFile(filename, file);
+}
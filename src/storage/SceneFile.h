@@ -0,0 +1,102 @@
+#ifndef VULK_SCENEFILE_H
+#define VULK_SCENEFILE_H
+
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "MappedFile.h"
+
+#define SCENE_FILE_MAGIC 0x4e435356 // "VSCN"
+#define SCENE_FILE_VERSION 1
+
+/*
+ * Everything in the file is stored as plain little-endian records. Offsets are in bytes from the start of the file and
+ * are aligned to 16 bytes. Vertex arrays use the in-memory Vertex layout, so they can be copied straight into a mesh.
+ */
+
+struct SceneHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertexSize;
+	uint32_t objectCount;
+	uint32_t modifierCount;
+	uint32_t systemCount;
+	uint64_t objectsOffset;
+	uint64_t modifiersOffset;
+	uint64_t systemsOffset;
+	uint64_t fileSize;
+};
+
+struct SceneObject {
+	float position[3];
+	float rotation[4]; // x, y, z, w
+	float scale[3];
+	int32_t parent; // -1 for root objects
+	uint32_t pipeline;
+	float collisionRadius; // 0 for objects without a collider
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+};
+
+enum SceneModifierType : uint32_t {
+	SCENE_MODIFIER_COSLINE = 1
+};
+
+struct SceneModifier {
+	uint32_t object;
+	uint32_t type;
+	float influences[3];
+	float amplitude;
+	float period;
+	float reserved;
+};
+
+struct SceneSystem {
+	uint32_t object;
+	uint32_t n;
+	float mass;
+	uint32_t springCount;
+	uint32_t fixedCount;
+	uint32_t reserved;
+	uint64_t orderOffset; // n * n grid to point index map
+	uint64_t springOffset;
+	uint64_t fixedOffset; // indexes of pinned points
+};
+
+struct SceneSpring {
+	uint32_t first;
+	uint32_t second;
+	float k;
+	float length;
+};
+
+/**
+ * Scene stored in a memory-mapped file. The arrays are accessed directly in the mapping, nothing is read or copied
+ * until the loader asks for it.
+ */
+class SceneFile {
+public:
+	explicit SceneFile(const std::string &filename);
+
+	const SceneHeader& getHeader() const;
+	ArrayView<SceneObject> getObjects() const;
+	ArrayView<SceneModifier> getModifiers() const;
+	ArrayView<SceneSystem> getSystems() const;
+
+	template<typename T>
+	ArrayView<T> array(uint64_t offset, size_t count) const{
+		return file.array<T>(offset, count);
+	}
+
+	// Writes the scene currently in Storage
+	static void write(const std::string &filename);
+
+private:
+	MappedFile file;
+};
+
+
+#endif //VULK_SCENEFILE_H
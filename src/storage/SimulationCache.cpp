@@ -0,0 +1,393 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include <glm/glm.hpp>
+#include "SimulationCache.h"
+#include "Storage.h"
+
+static void writeVarint(std::vector<char> &out, uint16_t value, uint16_t prev){
+	uint16_t delta = value - prev;
+	uint32_t zigzag = (uint16_t) ((delta << 1) ^ (delta & 0x8000 ? 0xffff : 0));
+
+	while(zigzag >= 0x80){
+		out.push_back((char) (zigzag | 0x80));
+		zigzag >>= 7;
+	}
+
+	out.push_back((char) zigzag);
+}
+
+SimulationCacheWriter::SimulationCacheWriter(const std::string &filename, float frameTime, bool normals, uint32_t chunkFrames)
+		: filename(filename), out(filename, std::ios::binary), normals(normals), chunkFrames(chunkFrames), frameTime(frameTime){
+	if(!out.is_open()){
+		throw std::runtime_error("failed to open file " + filename);
+	}
+
+	std::unordered_map<WorldObject*, uint32_t> objects;
+	for(uint32_t i = 0; i < Storage::worldObjects.size(); i++){
+		objects[Storage::worldObjects[i]] = i;
+	}
+
+	for(SpringSystem* system : Storage::sSystems){
+		const Mesh& mesh = system->object->renderComponent->mesh;
+
+		systems.push_back({ objects.at(system->object), (uint32_t) mesh.vertices.size() });
+		indices.push_back(mesh.indices);
+		sources.push_back(mesh.vertices.data());
+	}
+
+	// Header is filled in once the frame count and the index are known
+	CacheHeader header;
+	memset(&header, 0, sizeof(header));
+	writeAligned(&header, sizeof(header));
+
+	thread = std::thread(&SimulationCacheWriter::run, this);
+}
+
+SimulationCacheWriter::~SimulationCacheWriter(){
+	if(thread.joinable()){
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			finished = true;
+		}
+
+		available.notify_one();
+		thread.join();
+	}
+}
+
+void SimulationCacheWriter::capture(){
+	size_t size = 0;
+	for(const CacheSystem& system : systems){
+		size += system.pointCount;
+	}
+
+	Frame frame;
+	frame.reserve(size);
+
+	for(uint32_t s = 0; s < systems.size(); s++){
+		for(uint32_t i = 0; i < systems[s].pointCount; i++){
+			frame.push_back(sources[s][i].pos);
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back(std::move(frame));
+	}
+
+	available.notify_one();
+}
+
+/**
+ * Waits until every captured frame is written, then writes the chunk index and the header.
+ */
+void SimulationCacheWriter::finish(){
+	if(!thread.joinable()) return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		finished = true;
+	}
+
+	available.notify_one();
+	thread.join();
+
+	CacheHeader header;
+	memset(&header, 0, sizeof(header));
+
+	header.magic = CACHE_MAGIC;
+	header.version = CACHE_VERSION;
+	header.systemCount = systems.size();
+	header.flags = normals ? CACHE_NORMALS : 0;
+	header.frameTime = frameTime;
+	header.chunkFrames = chunkFrames;
+	header.frameCount = frameCount;
+	header.chunkCount = index.size();
+	header.systemsOffset = writeAligned(systems.data(), systems.size() * sizeof(CacheSystem));
+	header.indexOffset = writeAligned(index.data(), index.size() * sizeof(CacheChunk));
+	header.fileSize = fileSize;
+
+	out.seekp(0);
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.close();
+
+	if(out.fail()){
+		throw std::runtime_error("failed to write simulation cache " + filename);
+	}
+}
+
+uint32_t SimulationCacheWriter::getFrameCount() const{
+	return frameCount;
+}
+
+uint64_t SimulationCacheWriter::getFileSize() const{
+	return fileSize;
+}
+
+void SimulationCacheWriter::run(){
+	std::vector<Frame> frames;
+
+	while(true){
+		std::unique_lock<std::mutex> lock(mutex);
+		available.wait(lock, [this]{ return !queue.empty() || finished; });
+
+		if(queue.empty()) break;
+
+		frames.push_back(std::move(queue.front()));
+		queue.pop_front();
+		lock.unlock();
+
+		if(frames.size() == chunkFrames){
+			writeChunk(frames);
+			frames.clear();
+		}
+	}
+
+	if(!frames.empty()){
+		writeChunk(frames);
+	}
+}
+
+void SimulationCacheWriter::writeChunk(const std::vector<Frame> &frames){
+	std::vector<CacheBounds> bounds(systems.size());
+	std::vector<char> data;
+
+	// Bounds of every system over the whole chunk
+	for(uint32_t s = 0, first = 0; s < systems.size(); first += systems[s].pointCount, s++){
+		glm::vec3 min(INFINITY), max(-INFINITY);
+
+		for(const Frame& frame : frames){
+			for(uint32_t i = first; i < first + systems[s].pointCount; i++){
+				min = glm::min(min, frame[i]);
+				max = glm::max(max, frame[i]);
+			}
+		}
+
+		for(int c = 0; c < 3; c++){
+			bounds[s].min[c] = min[c];
+			bounds[s].step[c] = max[c] > min[c] ? (max[c] - min[c]) / 65535.0f : 1.0f;
+		}
+	}
+
+	data.resize(bounds.size() * sizeof(CacheBounds));
+	memcpy(data.data(), bounds.data(), data.size());
+
+	std::vector<std::vector<uint16_t>> previous(systems.size());
+	std::vector<uint16_t> quantized;
+	std::vector<glm::vec3> normals;
+
+	for(uint32_t f = 0; f < frames.size(); f++){
+		for(uint32_t s = 0, first = 0; s < systems.size(); first += systems[s].pointCount, s++){
+			uint32_t n = systems[s].pointCount;
+			quantized.resize(3 * n);
+
+			for(uint32_t i = 0; i < n; i++){
+				for(int c = 0; c < 3; c++){
+					float q = std::round((frames[f][first + i][c] - bounds[s].min[c]) / bounds[s].step[c]);
+					quantized[3 * i + c] = (uint16_t) std::min(std::max(q, 0.0f), 65535.0f);
+				}
+			}
+
+			// Key frame against the previous point, the rest against the previous frame
+			for(uint32_t i = 0; i < 3 * n; i++){
+				uint16_t prev = f == 0 ? (i >= 3 ? quantized[i - 3] : 0) : previous[s][i];
+				writeVarint(data, quantized[i], prev);
+			}
+
+			previous[s].swap(quantized);
+
+			if(SimulationCacheWriter::normals){
+				normals.assign(n, glm::vec3(0));
+
+				const std::vector<uint32_t>& triangles = indices[s];
+				for(size_t i = 0; i + 2 < triangles.size(); i += 3){
+					glm::vec3 a = frames[f][first + triangles[i]];
+					glm::vec3 b = frames[f][first + triangles[i + 1]];
+					glm::vec3 c = frames[f][first + triangles[i + 2]];
+
+					glm::vec3 faceNormal = glm::cross(b - a, c - b);
+					normals[triangles[i]] += faceNormal;
+					normals[triangles[i + 1]] += faceNormal;
+					normals[triangles[i + 2]] += faceNormal;
+				}
+
+				for(const glm::vec3& normal : normals){
+					float length = glm::length(normal);
+					glm::vec3 unit = length > 0 ? normal / length : glm::vec3(0);
+
+					for(int c = 0; c < 3; c++){
+						data.push_back((char) (int8_t) std::round(unit[c] * 127.0f));
+					}
+				}
+			}
+		}
+	}
+
+	CacheChunk chunk;
+	chunk.firstFrame = frameCount;
+	chunk.frameCount = frames.size();
+	chunk.size = data.size();
+	chunk.offset = writeAligned(data.data(), data.size());
+
+	index.push_back(chunk);
+	frameCount += frames.size();
+}
+
+uint64_t SimulationCacheWriter::writeAligned(const void* data, size_t bytes){
+	static const char padding[16] = {};
+
+	size_t aligned = (fileSize + 15) & ~(uint64_t) 15;
+	out.write(padding, aligned - fileSize);
+	out.write(static_cast<const char*>(data), bytes);
+
+	fileSize = aligned + bytes;
+	return aligned;
+}
+
+SimulationCache::SimulationCache(const std::string &filename) : file(filename){
+	header = file.at<CacheHeader>(0);
+	if(header.magic != CACHE_MAGIC || header.version != CACHE_VERSION || header.fileSize != file.getSize()){
+		throw std::runtime_error("unsupported simulation cache " + filename);
+	}
+
+	systems = file.array<CacheSystem>(header.systemsOffset, header.systemCount);
+	index = file.array<CacheChunk>(header.indexOffset, header.chunkCount);
+
+	if(header.frameCount == 0 || header.frameTime <= 0){
+		throw std::runtime_error("simulation cache " + filename + " has no frames!");
+	}
+
+	for(uint32_t i = 0; i < index.size; i++){
+		uint32_t expected = i == 0 ? 0 : index[i - 1].firstFrame + index[i - 1].frameCount;
+		if(index[i].firstFrame != expected || index[i].frameCount == 0){
+			throw std::runtime_error("corrupt simulation cache " + filename);
+		}
+
+		// Checks the chunk lies inside the file
+		file.array<uint8_t>(index[i].offset, index[i].size);
+	}
+
+	if(index.size == 0 || index[index.size - 1].firstFrame + index[index.size - 1].frameCount != header.frameCount){
+		throw std::runtime_error("corrupt simulation cache " + filename);
+	}
+
+	quantized.resize(systems.size);
+	positions.resize(systems.size);
+	normals.resize(systems.size);
+
+	for(uint32_t s = 0; s < systems.size; s++){
+		quantized[s].resize(3 * systems[s].pointCount);
+		positions[s].resize(systems[s].pointCount);
+		if(hasNormals()) normals[s].resize(systems[s].pointCount);
+	}
+}
+
+const CacheHeader& SimulationCache::getHeader() const{
+	return header;
+}
+
+ArrayView<CacheSystem> SimulationCache::getSystems() const{
+	return systems;
+}
+
+bool SimulationCache::hasNormals() const{
+	return header.flags & CACHE_NORMALS;
+}
+
+/**
+ * Decodes the given frame (clamped to the last one). Playing forward only decodes the frames in between, anything else
+ * starts from the key frame of the chunk holding the frame.
+ */
+void SimulationCache::seek(uint32_t frame){
+	frame = std::min(frame, header.frameCount - 1);
+	if(frame == SimulationCache::frame) return;
+
+	uint32_t target = std::upper_bound(index.begin(), index.end(), frame, [](uint32_t f, const CacheChunk& c){
+		return f < c.firstFrame;
+	}) - index.begin() - 1;
+
+	if(target != chunk || frame < SimulationCache::frame){
+		const CacheChunk& c = index[target];
+		ArrayView<uint8_t> data = file.array<uint8_t>(c.offset, c.size);
+
+		chunk = target;
+		bounds = file.array<CacheBounds>(c.offset, systems.size);
+		cursor = data.data + systems.size * sizeof(CacheBounds);
+		chunkEnd = data.end();
+
+		if(cursor > chunkEnd){
+			throw std::runtime_error("corrupt simulation cache!");
+		}
+
+		decodeFrame(true);
+		SimulationCache::frame = c.firstFrame;
+	}
+
+	while(SimulationCache::frame < frame){
+		decodeFrame(false);
+		SimulationCache::frame++;
+	}
+}
+
+const std::vector<glm::vec3>& SimulationCache::getPositions(uint32_t system) const{
+	return positions[system];
+}
+
+const std::vector<glm::vec3>& SimulationCache::getNormals(uint32_t system) const{
+	return normals[system];
+}
+
+void SimulationCache::decodeFrame(bool key){
+	for(uint32_t s = 0; s < systems.size; s++){
+		std::vector<uint16_t>& q = quantized[s];
+		uint32_t n = systems[s].pointCount;
+
+		for(uint32_t i = 0; i < 3 * n; i++){
+			uint16_t zigzag = readVarint();
+			uint16_t delta = (zigzag >> 1) ^ (uint16_t) -(zigzag & 1);
+			uint16_t prev = key ? (i >= 3 ? q[i - 3] : 0) : q[i];
+
+			q[i] = prev + delta;
+		}
+
+		const CacheBounds& b = bounds[s];
+		for(uint32_t i = 0; i < n; i++){
+			positions[s][i] = {
+					b.min[0] + q[3 * i] * b.step[0],
+					b.min[1] + q[3 * i + 1] * b.step[1],
+					b.min[2] + q[3 * i + 2] * b.step[2]
+			};
+		}
+
+		if(hasNormals()){
+			if(chunkEnd - cursor < 3 * (ptrdiff_t) n){
+				throw std::runtime_error("corrupt simulation cache!");
+			}
+
+			for(uint32_t i = 0; i < n; i++){
+				normals[s][i] = glm::vec3((int8_t) cursor[0], (int8_t) cursor[1], (int8_t) cursor[2]) / 127.0f;
+				cursor += 3;
+			}
+		}
+	}
+}
+
+uint32_t SimulationCache::readVarint(){
+	uint32_t value = 0;
+
+	for(int shift = 0; shift < 21; shift += 7){
+		if(cursor >= chunkEnd){
+			throw std::runtime_error("corrupt simulation cache!");
+		}
+
+		uint8_t byte = *cursor++;
+		value |= (uint32_t) (byte & 0x7f) << shift;
+
+		if((byte & 0x80) == 0) return value;
+	}
+
+	throw std::runtime_error("corrupt simulation cache!");
+}
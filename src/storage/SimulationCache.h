@@ -0,0 +1,150 @@
+#ifndef VULK_SIMULATIONCACHE_H
+#define VULK_SIMULATIONCACHE_H
+
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glm/vec3.hpp>
+#include "MappedFile.h"
+#include "../graphics/Mesh.h"
+
+#define CACHE_MAGIC 0x4d495356 // "VSIM"
+#define CACHE_VERSION 1
+
+#define CACHE_NORMALS 1
+
+/*
+ * Recorded cloth vertices, one frame every frameTime seconds. Frames are grouped into chunks of chunkFrames, the index
+ * at the end of the file gives the offset of every chunk so playback can seek without reading what comes before.
+ *
+ * Positions are quantized to 16 bits against the bounds of their system over the whole chunk. The first frame of a
+ * chunk stores every value as the difference to the previous point, the following frames as the difference to the same
+ * point in the previous frame. Differences are zigzag varints, so a cloth that barely moves costs a byte per value.
+ * Normals are stored as three signed bytes per point.
+ */
+
+struct CacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t systemCount;
+	uint32_t flags;
+	float frameTime;
+	uint32_t chunkFrames;
+	uint32_t frameCount;
+	uint32_t chunkCount;
+	uint64_t systemsOffset;
+	uint64_t indexOffset;
+	uint64_t fileSize;
+	uint64_t reserved;
+};
+
+struct CacheSystem {
+	uint32_t object; // index of the cloth object in the scene
+	uint32_t pointCount;
+};
+
+struct CacheChunk {
+	uint32_t firstFrame;
+	uint32_t frameCount;
+	uint64_t offset; // CacheBounds of every system followed by the encoded frames
+	uint64_t size;
+};
+
+struct CacheBounds {
+	float min[3];
+	float step[3];
+};
+
+/**
+ * Streams the cloth of the loaded scene into a simulation cache. Encoding and writing happen on a separate thread,
+ * capture() only copies the vertex positions.
+ */
+class SimulationCacheWriter {
+public:
+	SimulationCacheWriter(const std::string &filename, float frameTime, bool normals, uint32_t chunkFrames = 32);
+	~SimulationCacheWriter();
+
+	SimulationCacheWriter(const SimulationCacheWriter&) = delete;
+	SimulationCacheWriter& operator=(const SimulationCacheWriter&) = delete;
+
+	void capture();
+	void finish();
+
+	uint32_t getFrameCount() const;
+	uint64_t getFileSize() const;
+
+private:
+	// Positions of all systems one after another
+	typedef std::vector<glm::vec3> Frame;
+
+	std::string filename;
+	std::ofstream out;
+	bool normals;
+	uint32_t chunkFrames;
+	float frameTime;
+
+	std::vector<CacheSystem> systems;
+	std::vector<std::vector<uint32_t>> indices;
+	std::vector<const Vertex*> sources;
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable available;
+	std::deque<Frame> queue;
+	bool finished = false;
+
+	// Only touched by the writer thread until it is joined
+	std::vector<CacheChunk> index;
+	uint32_t frameCount = 0;
+	uint64_t fileSize = 0;
+
+	void run();
+	void writeChunk(const std::vector<Frame> &frames);
+	uint64_t writeAligned(const void* data, size_t bytes);
+};
+
+/**
+ * Reads frames of a simulation cache through a memory mapping.
+ */
+class SimulationCache {
+public:
+	explicit SimulationCache(const std::string &filename);
+
+	const CacheHeader& getHeader() const;
+	ArrayView<CacheSystem> getSystems() const;
+	bool hasNormals() const;
+
+	void seek(uint32_t frame);
+
+	const std::vector<glm::vec3>& getPositions(uint32_t system) const;
+	const std::vector<glm::vec3>& getNormals(uint32_t system) const;
+
+private:
+	MappedFile file;
+	CacheHeader header;
+	ArrayView<CacheSystem> systems;
+	ArrayView<CacheChunk> index;
+
+	// Decoding position, frames after the current one are decoded without going back to the chunk start
+	uint32_t chunk = UINT32_MAX;
+	uint32_t frame = UINT32_MAX;
+	ArrayView<CacheBounds> bounds;
+	const uint8_t* cursor = nullptr;
+	const uint8_t* chunkEnd = nullptr;
+
+	std::vector<std::vector<uint16_t>> quantized;
+	std::vector<std::vector<glm::vec3>> positions;
+	std::vector<std::vector<glm::vec3>> normals;
+
+	void decodeFrame(bool key);
+	uint32_t readVarint();
+};
+
+
+#endif //VULK_SIMULATIONCACHE_H
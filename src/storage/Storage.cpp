@@ -1,64 +1,164 @@
 #include "Storage.h"
 #include "../springsystem/SpringSystem.h"
+#include "../physics/CollisionSphere.h"
+#include "../curves/CosLine.h"
+#include "../springsystem/ClothLOD.h"
+#include "../springsystem/ClothRefinement.h"
 
-std::vector<RenderComponent*> Storage::renderObjects;
-std::vector<WorldObject*> Storage::worldObjects;
-std::vector<Spring*> Storage::springs;
-std::vector<SpringSystem*> Storage::sSystems;
-std::array<std::vector<RenderComponent*>, 2> Storage::renderObjectGarbage;
+thread_local ComponentRegistry<RenderComponent> Storage::renderObjects;
+thread_local ComponentRegistry<WorldObject> Storage::worldObjects;
+thread_local ComponentRegistry<Spring> Storage::springs;
+thread_local ComponentRegistry<SpringSystem> Storage::sSystems;
+thread_local std::vector<IFrameBound*> Storage::frameObjects;
+thread_local std::vector<ClothLOD*> Storage::clothLods;
+thread_local std::array<std::vector<RenderComponent*>, 2> Storage::renderObjectGarbage;
 
-int Storage::frame = 0;
+thread_local int Storage::frame = 0;
 
-Graphics *Storage::graphics;
+thread_local std::vector<MeshTransforms> Storage::transforms = { { glm::mat4(1.0f), glm::mat4(1.0f) } };
+thread_local std::vector<WorldObject*> Storage::dirtyObjects;
+thread_local std::vector<uint32_t> Storage::freeTransforms;
+
+thread_local Graphics *Storage::graphics;
+
+thread_local Arena Storage::arena;
+thread_local Pool<WorldObject> Storage::worldObjectPool(arena);
+thread_local Pool<RenderComponent> Storage::renderComponentPool(arena);
+thread_local Pool<CollisionComponent> Storage::collisionComponentPool(arena);
+thread_local Pool<CollisionSphere> Storage::collisionSpherePool(arena);
+thread_local Pool<CosLine> Storage::cosLinePool(arena);
+thread_local Pool<SpringSystem> Storage::springSystemPool(arena, 4);
+thread_local Pool<MassPoint> Storage::massPointPool(arena, 1024);
+thread_local Pool<Spring> Storage::springPool(arena, 1024);
+thread_local Pool<ClothLOD> Storage::clothLodPool(arena, 4);
+thread_local Pool<ClothRefinement> Storage::clothRefinementPool(arena, 4);
+
+template<> Pool<WorldObject>& Storage::pool<WorldObject>(){ return worldObjectPool; }
+template<> Pool<RenderComponent>& Storage::pool<RenderComponent>(){ return renderComponentPool; }
+template<> Pool<CollisionComponent>& Storage::pool<CollisionComponent>(){ return collisionComponentPool; }
+template<> Pool<CollisionSphere>& Storage::pool<CollisionSphere>(){ return collisionSpherePool; }
+template<> Pool<CosLine>& Storage::pool<CosLine>(){ return cosLinePool; }
+template<> Pool<SpringSystem>& Storage::pool<SpringSystem>(){ return springSystemPool; }
+template<> Pool<MassPoint>& Storage::pool<MassPoint>(){ return massPointPool; }
+template<> Pool<Spring>& Storage::pool<Spring>(){ return springPool; }
+template<> Pool<ClothLOD>& Storage::pool<ClothLOD>(){ return clothLodPool; }
+template<> Pool<ClothRefinement>& Storage::pool<ClothRefinement>(){ return clothRefinementPool; }
 
 void Storage::init(Graphics *graphics){
 	Storage::graphics = graphics;
 }
 
 void Storage::addRenderObject(RenderComponent *rObj){
+	// The constructor already added it to renderObjects
 	graphics->regObject(rObj);
-	renderObjects.push_back(rObj);
 }
 
 void Storage::removeRenderObject(RenderComponent *rObj){
 	renderObjectGarbage[frame].push_back(rObj);
-	renderObjects.erase(std::remove(renderObjects.begin(), renderObjects.end(), rObj), renderObjects.end());
+	renderObjects.remove(rObj->handle);
+	if(graphics != nullptr) graphics->invalidateCommands();
 }
 
 void Storage::removeWorldObject(WorldObject *wObj){
-	worldObjects.erase(std::remove(worldObjects.begin(), worldObjects.end(), wObj), worldObjects.end());
-	delete wObj;
+	// Children stay in the scene without a parent
+	wObj->setParent(nullptr);
+	std::vector<WorldObject*> children = wObj->getChildren();
+	for(WorldObject* child : children){
+		child->setParent(nullptr);
+	}
+
+	worldObjects.remove(wObj->handle);
+	removeTransform(wObj->getTransformSlot());
+
+	if(wObj->isDirty()){
+		dirtyObjects.erase(std::remove(dirtyObjects.begin(), dirtyObjects.end(), wObj), dirtyObjects.end());
+	}
+
+	worldObjectPool.destroy(wObj);
+}
+
+uint32_t Storage::addTransform(){
+	if(!freeTransforms.empty()){
+		uint32_t slot = freeTransforms.back();
+		freeTransforms.pop_back();
+		return slot;
+	}
+
+	transforms.push_back({ glm::mat4(1.0f), glm::mat4(1.0f) });
+	return transforms.size() - 1;
 }
 
+void Storage::removeTransform(uint32_t slot){
+	freeTransforms.push_back(slot);
+}
+
+/**
+ * Only objects that were moved since the last update (and their children) get their matrices recomputed.
+ */
+void Storage::updateTransforms(){
+	for(WorldObject* wObj : dirtyObjects){
+		if(wObj->isDirty()) wObj->updateTransformation();
+	}
+
+	dirtyObjects.clear();
+}
 
 void Storage::clearGarbage(){
 	frame = (frame+1) % 2;
 
 	for(RenderComponent* rObj : renderObjectGarbage[frame]){
 		graphics->deregObject(rObj);
-		delete rObj;
+		renderComponentPool.destroy(rObj);
 	}
 
 	renderObjectGarbage[frame].clear();
 }
 
 void Storage::cleanup(){
-	for(RenderComponent* rObj : renderObjects){
-		graphics->deregObject(rObj);
-		delete rObj;
-	}
+	// Without graphics (benchmark mode) nothing was uploaded
+	if(graphics != nullptr){
+		for(RenderComponent* rObj : renderObjects){
+			graphics->deregObject(rObj);
+		}
 
-	for(int i = 0; i < Storage::springs.size(); i++){
-		graphics->deregSpring(Storage::springs[i]);
+		for(int i = 0; i < Storage::springs.size(); i++){
+			graphics->deregSpring(Storage::springs[i]);
+		}
+
+		for(SpringSystem* system : sSystems){
+			if(system->gpu) graphics->deregSystem(system);
+		}
 	}
 
 	for(WorldObject* wObj : worldObjects){
 		wObj->cleanup();
-		delete wObj;
 	}
 
 	renderObjects.clear();
 	worldObjects.clear();
 	springs.clear();
 	sSystems.clear();
+	frameObjects.clear();
+	clothLods.clear();
+
+	transforms.resize(1);
+	freeTransforms.clear();
+	dirtyObjects.clear();
+
+	releaseScene();
+}
+
+void Storage::releaseScene(){
+	clothRefinementPool.clear();
+	clothLodPool.clear();
+	springSystemPool.clear();
+	springPool.clear();
+	massPointPool.clear();
+	cosLinePool.clear();
+	collisionSpherePool.clear();
+	collisionComponentPool.clear();
+	renderComponentPool.clear();
+	worldObjectPool.clear();
+
+	arena.reset();
 }
@@ -9,16 +9,28 @@
 #include "../springsystem/MassPoint.h"
 #include "../springsystem/Spring.h"
 #include "../springsystem/SpringSystem.h"
+#include "../interfaces/IFrameBound.h"
+#include "Arena.h"
+#include "Pool.h"
+#include "ComponentRegistry.h"
 
+class CollisionSphere;
+class CosLine;
+class ClothLOD;
+class ClothRefinement;
+
+// Every thread has its own scene storage, so parameter sweeps can simulate several scenes side by side
 class Storage {
 public:
 	static void init(Graphics *graphics);
 
-	static std::vector<RenderComponent*> renderObjects;
-	static std::vector<WorldObject*> worldObjects;
-	static std::vector<Bspline*> splines;
-	static std::vector<Spring*> springs;
-	static std::vector<SpringSystem*> sSystems;
+	static thread_local ComponentRegistry<RenderComponent> renderObjects;
+	static thread_local ComponentRegistry<WorldObject> worldObjects;
+	static thread_local std::vector<Bspline*> splines;
+	static thread_local ComponentRegistry<Spring> springs;
+	static thread_local ComponentRegistry<SpringSystem> sSystems;
+	static thread_local std::vector<IFrameBound*> frameObjects;
+	static thread_local std::vector<ClothLOD*> clothLods;
 
 	static void addRenderObject(RenderComponent *rObj);
 	static void removeRenderObject(RenderComponent *rObj);
@@ -28,12 +40,55 @@ public:
 
 	static void removeWorldObject(WorldObject *wObj);
 
+	// Object matrices packed in one array, slot 0 is the identity used by objects without a world object
+	static thread_local std::vector<MeshTransforms> transforms;
+	static thread_local std::vector<WorldObject*> dirtyObjects;
+
+	static uint32_t addTransform();
+	static void removeTransform(uint32_t slot);
+	static void updateTransforms();
+
+	// Objects of a scene are created in per-type pools on the scene arena, cleanup() releases all of them at once
+	template<typename T, typename... Args>
+	static T* create(Args&&... args){
+		return pool<T>().create(std::forward<Args>(args)...);
+	}
+
+	template<typename T>
+	static Pool<T>& pool();
+
 private:
-	static Graphics *graphics;
+	static thread_local Graphics *graphics;
+
+	static thread_local Arena arena;
+	static thread_local Pool<WorldObject> worldObjectPool;
+	static thread_local Pool<RenderComponent> renderComponentPool;
+	static thread_local Pool<CollisionComponent> collisionComponentPool;
+	static thread_local Pool<CollisionSphere> collisionSpherePool;
+	static thread_local Pool<CosLine> cosLinePool;
+	static thread_local Pool<SpringSystem> springSystemPool;
+	static thread_local Pool<MassPoint> massPointPool;
+	static thread_local Pool<Spring> springPool;
+	static thread_local Pool<ClothLOD> clothLodPool;
+	static thread_local Pool<ClothRefinement> clothRefinementPool;
 
-	static int frame;
-	static std::array<std::vector<RenderComponent*>, 2> renderObjectGarbage;
+	static void releaseScene();
+
+	static thread_local int frame;
+	static thread_local std::vector<uint32_t> freeTransforms;
+	static thread_local std::array<std::vector<RenderComponent*>, 2> renderObjectGarbage;
 };
 
+template<> Pool<WorldObject>& Storage::pool<WorldObject>();
+template<> Pool<RenderComponent>& Storage::pool<RenderComponent>();
+template<> Pool<CollisionComponent>& Storage::pool<CollisionComponent>();
+template<> Pool<CollisionSphere>& Storage::pool<CollisionSphere>();
+template<> Pool<CosLine>& Storage::pool<CosLine>();
+template<> Pool<SpringSystem>& Storage::pool<SpringSystem>();
+template<> Pool<MassPoint>& Storage::pool<MassPoint>();
+template<> Pool<Spring>& Storage::pool<Spring>();
+template<> Pool<ClothLOD>& Storage::pool<ClothLOD>();
+template<> Pool<ClothRefinement>& Storage::pool<ClothRefinement>();
+
 
 #endif //VULK_STORAGE_H
@@ -5,8 +5,17 @@
 #include "../curves/CosLine.h"
 #include "../physics/CollisionSphere.h"
 #include "../data.h"
+#include "../storage/SceneFile.h"
+#include "../graphics/MeshCache.h"
+#include <glm/gtc/type_ptr.hpp>
 
 void World::load(int scene){
+	if(scene == 0){
+		loadFile(sceneFile);
+		updateTransformationmatrices();
+		return;
+	}
+
 	Mesh GroundPlane = Mesh({
 			   {{-5.0f, -5.0f, 0.0f}, {0.5f, 0.5f, 0.5f}, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f }},
 			   {{5.0f,  -5.0f, 0.0f}, {0.5f, 0.5f, 0.5f}, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f }},
@@ -14,8 +23,8 @@ void World::load(int scene){
 			   {{-5.0f, 5.0f, 0.0f},  {0.5f, 0.5f, 0.5f}, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f }}
 	   }, { 0, 1, 2, 2, 3, 0 });
 
-	WorldObject* gpObject = new WorldObject();
-	gpObject->setRender(new RenderComponent(GroundPlane));
+	WorldObject* gpObject = Storage::create<WorldObject>();
+	gpObject->setRender(Storage::create<RenderComponent>(GroundPlane));
 
 	switch(scene){
 		case 1:
@@ -33,66 +42,163 @@ void World::load(int scene){
 }
 
 void World::load1(){
-	Mesh plane = Mesh::generatePlane({ 1, 3 }, { -1, 1 }, noPoints);
-	WorldObject* planeObj = new WorldObject();
-	planeObj->setRender(new RenderComponent(plane));
+	const Mesh& plane = *MeshCache::plane({ 1, 3 }, { -1, 1 }, noPoints);
+	WorldObject* planeObj = Storage::create<WorldObject>();
+	planeObj->setRender(Storage::create<RenderComponent>(plane));
 
-	SpringSystem* system = new SpringSystem(planeObj, noPoints, 20);
+	SpringSystem* system = Storage::create<SpringSystem>(planeObj, noPoints, 20);
 	system->setFixed(0, 0, true);
 	system->setFixed(noPoints-1, 0, true);
 	planeObj->setPhysics(system);
 
-	Mesh mesh = Mesh::generateSphere(0.29, 20, 20);
-	WorldObject* ballObj = new WorldObject({ 0.5, -0.6, 2.0 }, { 0.0, 0.0, 0.0, 0.0 }, { 1.0, 1.0, 1.0 });	ballObj->setRender(new RenderComponent(mesh));
-	ballObj->setCollision(new CollisionComponent(ballObj, new CollisionSphere(0.3)));
-	ballObj->addModifier(new CosLine(ballObj, { 0, -1, 0 }, 1, 8));
+	WorldObject* ballObj = Storage::create<WorldObject>(glm::vec3(0.5, -0.6, 2.0), glm::quat(0.0, 0.0, 0.0, 0.0), glm::vec3(1.0, 1.0, 1.0));	ballObj->setRender(Storage::create<RenderComponent>(MeshCache::sphere(0.29, 20, 20)));
+	ballObj->setCollision(Storage::create<CollisionComponent>(ballObj, Storage::create<CollisionSphere>(0.3)));
+	ballObj->addModifier(Storage::create<CosLine>(ballObj, glm::vec3(0, -1, 0), 1, 8));
 
-	mesh = Mesh::generateSphere(0.29, 20, 20);
-	ballObj = new WorldObject({ -0.5, 0.6, 2.0 }, { 0.0, 0.0, 0.0, 0.0 }, { 1.0, 1.0, 1.0 });	ballObj->setRender(new RenderComponent(mesh));
-	ballObj->setCollision(new CollisionComponent(ballObj, new CollisionSphere(0.3)));
-	ballObj->addModifier(new CosLine(ballObj, { 0, 1, 0 }, 1, 8));
+	ballObj = Storage::create<WorldObject>(glm::vec3(-0.5, 0.6, 2.0), glm::quat(0.0, 0.0, 0.0, 0.0), glm::vec3(1.0, 1.0, 1.0));	ballObj->setRender(Storage::create<RenderComponent>(MeshCache::sphere(0.29, 20, 20)));
+	ballObj->setCollision(Storage::create<CollisionComponent>(ballObj, Storage::create<CollisionSphere>(0.3)));
+	ballObj->addModifier(Storage::create<CosLine>(ballObj, glm::vec3(0, 1, 0), 1, 8));
 }
 
 void World::load2(){
-	Mesh plane = Mesh::generatePlane({ 1, 3 }, { -1, 1 }, noPoints);
-	WorldObject* planeObj = new WorldObject();
-	planeObj->setRender(new RenderComponent(plane));
+	const Mesh& plane = *MeshCache::plane({ 1, 3 }, { -1, 1 }, noPoints);
+	WorldObject* planeObj = Storage::create<WorldObject>();
+	planeObj->setRender(Storage::create<RenderComponent>(plane));
 
-	SpringSystem* system = new SpringSystem(planeObj, noPoints, 20);
+	SpringSystem* system = Storage::create<SpringSystem>(planeObj, noPoints, 20);
 	system->setFixed(0, 0, true);
 	system->setFixed(noPoints-1, 0, true);
 	planeObj->setPhysics(system);
 
-	Mesh mesh = Mesh::generateSphere(0.49, 20, 20);
-	WorldObject* ballObj = new WorldObject({ 0.0, 0.7, 2.0 }, { 0.0, 0.0, 0.0, 0.0 }, { 1.0, 1.0, 1.0 });	ballObj->setRender(new RenderComponent(mesh));
-	ballObj->setCollision(new CollisionComponent(ballObj, new CollisionSphere(0.5)));
-	ballObj->addModifier(new CosLine(ballObj, { 0, 1, 0 }, 1, 5));
+	WorldObject* ballObj = Storage::create<WorldObject>(glm::vec3(0.0, 0.7, 2.0), glm::quat(0.0, 0.0, 0.0, 0.0), glm::vec3(1.0, 1.0, 1.0));	ballObj->setRender(Storage::create<RenderComponent>(MeshCache::sphere(0.49, 20, 20)));
+	ballObj->setCollision(Storage::create<CollisionComponent>(ballObj, Storage::create<CollisionSphere>(0.5)));
+	ballObj->addModifier(Storage::create<CosLine>(ballObj, glm::vec3(0, 1, 0), 1, 5));
 }
 
 void World::load3(){
-	Mesh plane = Mesh::generatePlane({ -2, -2 }, { 2, 2 }, noPoints, true);
-	WorldObject* planeObj = new WorldObject();
-	planeObj->setRender(new RenderComponent(plane));
-	planeObj->position = { 0, 0, 3.0 };
+	const Mesh& plane = *MeshCache::plane({ -2, -2 }, { 2, 2 }, noPoints, true);
+	WorldObject* planeObj = Storage::create<WorldObject>();
+	planeObj->setRender(Storage::create<RenderComponent>(plane));
+	planeObj->setPosition({ 0, 0, 3.0 });
 
-	SpringSystem* system = new SpringSystem(planeObj, noPoints, 20);
+	SpringSystem* system = Storage::create<SpringSystem>(planeObj, noPoints, 20);
 	planeObj->setPhysics(system);
 
-	Mesh mesh = Mesh::generateSphere(0.29, 20, 20);
-	WorldObject* ballObj = new WorldObject({ 1, 1, 2.0 }, { 0.0, 0.0, 0.0, 0.0 }, { 1.0, 1.0, 1.0 });	ballObj->setRender(new RenderComponent(mesh));
-	ballObj->setCollision(new CollisionComponent(ballObj, new CollisionSphere(0.3)));
+	WorldObject* ballObj = Storage::create<WorldObject>(glm::vec3(1, 1, 2.0), glm::quat(0.0, 0.0, 0.0, 0.0), glm::vec3(1.0, 1.0, 1.0));	ballObj->setRender(Storage::create<RenderComponent>(MeshCache::sphere(0.29, 20, 20)));
+	ballObj->setCollision(Storage::create<CollisionComponent>(ballObj, Storage::create<CollisionSphere>(0.3)));
 
-	mesh = Mesh::generateSphere(0.29, 20, 20);
-	ballObj = new WorldObject({ 1, -1, 2.0 }, { 0.0, 0.0, 0.0, 0.0 }, { 1.0, 1.0, 1.0 });	ballObj->setRender(new RenderComponent(mesh));
-	ballObj->setCollision(new CollisionComponent(ballObj, new CollisionSphere(0.3)));
+	ballObj = Storage::create<WorldObject>(glm::vec3(1, -1, 2.0), glm::quat(0.0, 0.0, 0.0, 0.0), glm::vec3(1.0, 1.0, 1.0));	ballObj->setRender(Storage::create<RenderComponent>(MeshCache::sphere(0.29, 20, 20)));
+	ballObj->setCollision(Storage::create<CollisionComponent>(ballObj, Storage::create<CollisionSphere>(0.3)));
 
-	mesh = Mesh::generateSphere(0.29, 20, 20);
-	ballObj = new WorldObject({ -1, 1, 2.0 }, { 0.0, 0.0, 0.0, 0.0 }, { 1.0, 1.0, 1.0 });	ballObj->setRender(new RenderComponent(mesh));
-	ballObj->setCollision(new CollisionComponent(ballObj, new CollisionSphere(0.3)));
+	ballObj = Storage::create<WorldObject>(glm::vec3(-1, 1, 2.0), glm::quat(0.0, 0.0, 0.0, 0.0), glm::vec3(1.0, 1.0, 1.0));	ballObj->setRender(Storage::create<RenderComponent>(MeshCache::sphere(0.29, 20, 20)));
+	ballObj->setCollision(Storage::create<CollisionComponent>(ballObj, Storage::create<CollisionSphere>(0.3)));
 
-	mesh = Mesh::generateSphere(0.29, 20, 20);
-	ballObj = new WorldObject({ -1, -1, 2.0 }, { 0.0, 0.0, 0.0, 0.0 }, { 1.0, 1.0, 1.0 });	ballObj->setRender(new RenderComponent(mesh));
-	ballObj->setCollision(new CollisionComponent(ballObj, new CollisionSphere(0.3)));
+	ballObj = Storage::create<WorldObject>(glm::vec3(-1, -1, 2.0), glm::quat(0.0, 0.0, 0.0, 0.0), glm::vec3(1.0, 1.0, 1.0));	ballObj->setRender(Storage::create<RenderComponent>(MeshCache::sphere(0.29, 20, 20)));
+	ballObj->setCollision(Storage::create<CollisionComponent>(ballObj, Storage::create<CollisionSphere>(0.3)));
+}
+
+/**
+ * Loads a scene written by SceneFile::write. Cloth meshes are copied out of the mapping (the simulation moves their
+ * vertices), other meshes come from MeshCache, so objects stored with the same arrays share one mesh. Springs are built
+ * directly from the stored topology instead of being constructed again.
+ */
+void World::loadFile(const std::string &filename){
+	SceneFile file(filename);
+
+	std::vector<WorldObject*> objects;
+
+	std::vector<bool> cloth(file.getObjects().size, false);
+	for(const SceneSystem& record : file.getSystems()){
+		if(record.object < cloth.size()) cloth[record.object] = true;
+	}
+
+	for(const SceneObject& record : file.getObjects()){
+		WorldObject* object = Storage::create<WorldObject>(glm::make_vec3(record.position),
+				glm::quat(record.rotation[3], record.rotation[0], record.rotation[1], record.rotation[2]),
+				glm::make_vec3(record.scale));
+
+		if(record.vertexCount > 0){
+			// Render objects use the topo (0) or the cloth (2) pipeline, 1 only draws springs
+			if(record.pipeline != 0 && record.pipeline != 2) throw std::runtime_error("corrupt scene file!");
+
+			auto load = [&]{
+				ArrayView<Vertex> vertices = file.array<Vertex>(record.vertexOffset, record.vertexCount);
+				ArrayView<uint32_t> indices = file.array<uint32_t>(record.indexOffset, record.indexCount);
+
+				for(uint32_t index : indices){
+					if(index >= vertices.size) throw std::runtime_error("corrupt scene file!");
+				}
+
+				return Mesh(std::vector<Vertex>(vertices.begin(), vertices.end()), std::vector<uint32_t>(indices.begin(), indices.end()));
+			};
+
+			RenderComponent* rObj;
+			if(cloth[objects.size()]){
+				rObj = Storage::create<RenderComponent>(load());
+			}else{
+				rObj = Storage::create<RenderComponent>(MeshCache::stored(filename, record.vertexOffset, record.indexOffset, load));
+			}
+
+			rObj->pipeline = record.pipeline;
+			object->setRender(rObj);
+		}
+
+		if(record.collisionRadius > 0){
+			object->setCollision(Storage::create<CollisionComponent>(object, Storage::create<CollisionSphere>(record.collisionRadius)));
+		}
+
+		objects.push_back(object);
+	}
+
+	// Parents can come after their children, so the chain is followed instead of checking the order. A chain longer
+	// than the object count goes around a cycle
+	ArrayView<SceneObject> records = file.getObjects();
+	for(size_t i = 0; i < records.size; i++){
+		size_t steps = 0;
+		for(int32_t parent = records[i].parent; parent >= 0; parent = records[parent].parent){
+			if(parent >= (int32_t) records.size || ++steps > records.size) throw std::runtime_error("corrupt scene file!");
+		}
+	}
+
+	for(int i = 0; i < objects.size(); i++){
+		int32_t parent = records[i].parent;
+		if(parent >= 0) objects[i]->setParent(objects[parent]);
+	}
+
+	for(const SceneModifier& record : file.getModifiers()){
+		if(record.type == SCENE_MODIFIER_COSLINE){
+			objects.at(record.object)->addModifier(Storage::create<CosLine>(objects.at(record.object),
+					glm::make_vec3(record.influences), record.amplitude, record.period));
+		}
+	}
+
+	for(const SceneSystem& record : file.getSystems()){
+		ArrayView<uint32_t> order = file.array<uint32_t>(record.orderOffset, (size_t) record.n * record.n);
+		ArrayView<SceneSpring> springs = file.array<SceneSpring>(record.springOffset, record.springCount);
+		ArrayView<uint32_t> fixed = file.array<uint32_t>(record.fixedOffset, record.fixedCount);
+
+		WorldObject* object = objects.at(record.object);
+		if(object->renderComponent == nullptr || object->renderComponent->mesh.vertices.size() != order.size){
+			throw std::runtime_error("scene file spring system doesn't match its mesh!");
+		}
+
+		// The order indexes the mesh and the points, it has to be a permutation of them
+		std::vector<bool> seen(order.size, false);
+		for(uint32_t point : order){
+			if(point >= order.size || seen[point]) throw std::runtime_error("corrupt scene file!");
+			seen[point] = true;
+		}
+
+		SpringSystem* system = Storage::create<SpringSystem>(object, record.n, record.mass,
+				std::vector<uint32_t>(order.begin(), order.end()), springs);
+
+		for(uint32_t point : fixed){
+			if(point >= system->getNoPoints()) throw std::runtime_error("corrupt scene file!");
+			system->getPoint(point)->setFixed(true);
+		}
+
+		object->setPhysics(system);
+	}
 }
 
 void World::cleanup(){
@@ -102,13 +208,10 @@ void World::cleanup(){
 }
 
 WorldObject* World::loadModel(const Mesh mesh, glm::vec3 translation, glm::vec3 rotation, glm::vec3 scale){
-	RenderComponent *rObj = new RenderComponent(mesh);
-	WorldObject *wObj = new WorldObject(translation, rotation, scale);
+	RenderComponent *rObj = Storage::create<RenderComponent>(mesh);
+	WorldObject *wObj = Storage::create<WorldObject>(translation, rotation, scale);
 	wObj->setRender(rObj);
 
-	Storage::renderObjects.push_back(rObj);
-	Storage::worldObjects.push_back(wObj);
-
 	return wObj;
 }
 
@@ -123,12 +226,16 @@ void World::update(double time){
 	updateTransformationmatrices();
 }
 
-void World::updateTransformationmatrices(){
-	for(int i = 0; i < Storage::worldObjects.size(); i++){
-		Storage::worldObjects[i]->setTransformation();
+void World::frameUpdate(const FrameView &view){
+	for(IFrameBound* object : Storage::frameObjects){
+		object->frameUpdate(view);
 	}
 }
 
+void World::updateTransformationmatrices(){
+	Storage::updateTransforms();
+}
+
 World::World(){
 
 }
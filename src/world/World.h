@@ -5,6 +5,7 @@
 #include <vector>
 #include "WorldObject.h"
 #include "../interfaces/ITimeBound.h"
+#include "../interfaces/IFrameBound.h"
 #include "../springsystem/SpringSystem.h"
 
 class World : ITimeBound {
@@ -15,8 +16,10 @@ public:
 	void load1();
 	void load2();
 	void load3();
+	void loadFile(const std::string &filename);
 	void cleanup();
 	virtual void update(double time);
+	void frameUpdate(const FrameView& view);
 
 private:
 	WorldObject * loadModel(const Mesh mesh, glm::vec3 translation, glm::vec3 rotation, glm::vec3 scale);
@@ -1,14 +1,38 @@
+#include <algorithm>
+#include <stdexcept>
 #include "WorldObject.h"
 #include "../storage/Storage.h"
 
 WorldObject::WorldObject(const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale)
 		: position(position), rotation(rotation), scale(scale){
 
-	Storage::worldObjects.push_back(this);
+	handle = Storage::worldObjects.add(this);
+	transformSlot = Storage::addTransform();
+	markDirty();
 }
 
+void WorldObject::markDirty(){
+	if(dirty) return;
 
-void WorldObject::setTransformation(){
+	dirty = true;
+	Storage::dirtyObjects.push_back(this);
+}
+
+/**
+ * Recomputes the matrices of the object and its children. If an ancestor was also moved, the whole subtree of the
+ * topmost moved ancestor is recomputed instead, so children always see their parent's new matrices.
+ */
+void WorldObject::updateTransformation(){
+	WorldObject* root = this;
+
+	for(WorldObject* obj = parent; obj != nullptr; obj = obj->parent){
+		if(obj->dirty) root = obj;
+	}
+
+	root->computeTransformation();
+}
+
+void WorldObject::computeTransformation(){
 	glm::mat4 translation = glm::translate(glm::mat4(1.0f), position);
 
 	/*glm::mat4 matPitch = glm::rotate(glm::mat4(1.0f), rotation.x, glm::vec3(1.0f, 0.0f, 0.0f));
@@ -36,8 +60,21 @@ void WorldObject::setTransformation(){
 
 	glm::mat4 rotate = glm::toMat4(rotation);
 
-	renderComponent->transforms.tObject = translation * rotate * scal;
-	renderComponent->transforms.tNormal = rotate;
+	MeshTransforms& transforms = Storage::transforms[transformSlot];
+	transforms.tObject = translation * rotate * scal;
+	transforms.tNormal = rotate;
+
+	if(parent != nullptr){
+		const MeshTransforms& parentTransforms = Storage::transforms[parent->transformSlot];
+		transforms.tObject = parentTransforms.tObject * transforms.tObject;
+		transforms.tNormal = parentTransforms.tNormal * transforms.tNormal;
+	}
+
+	dirty = false;
+
+	for(WorldObject* child : children){
+		child->computeTransformation();
+	}
 }
 
 void WorldObject::update(double time){
@@ -50,9 +87,13 @@ void WorldObject::addModifier(IObjectModifier *modifier){
 	modifiers.push_back(modifier);
 }
 
+const std::vector<IObjectModifier*>& WorldObject::getModifiers() const{
+	return modifiers;
+}
+
 void WorldObject::setRender(RenderComponent *renderComponent){
 	WorldObject::renderComponent = renderComponent;
-	setTransformation();
+	renderComponent->transformSlot = transformSlot;
 }
 
 void WorldObject::setCollision(CollisionComponent *collisionComponent){
@@ -60,15 +101,84 @@ void WorldObject::setCollision(CollisionComponent *collisionComponent){
 }
 
 WorldObject::WorldObject() : position({ 0, 0, 0 }), rotation({ 0, 0, 0 }), scale({ 1, 1, 1 }){
-	Storage::worldObjects.push_back(this);
+	handle = Storage::worldObjects.add(this);
+	transformSlot = Storage::addTransform();
+	markDirty();
 }
 
 void WorldObject::setPhysics(IPhysicsComponent *physicsComponent){
 	WorldObject::physicsComponent = physicsComponent;
 }
 
-void WorldObject::cleanup(){
-	for(IObjectModifier* modifier : modifiers){
-		delete modifier;
+const glm::vec3& WorldObject::getPosition() const{
+	return position;
+}
+
+const glm::quat& WorldObject::getRotation() const{
+	return rotation;
+}
+
+const glm::vec3& WorldObject::getScale() const{
+	return scale;
+}
+
+void WorldObject::setPosition(const glm::vec3& position){
+	WorldObject::position = position;
+	markDirty();
+}
+
+void WorldObject::setRotation(const glm::quat& rotation){
+	WorldObject::rotation = rotation;
+	markDirty();
+}
+
+void WorldObject::setScale(const glm::vec3& scale){
+	WorldObject::scale = scale;
+	markDirty();
+}
+
+void WorldObject::move(const glm::vec3& direction){
+	position += direction;
+	markDirty();
+}
+
+void WorldObject::setParent(WorldObject* parent){
+	// A cycle would make the transform update recurse forever
+	for(WorldObject* ancestor = parent; ancestor != nullptr; ancestor = ancestor->parent){
+		if(ancestor == this) throw std::runtime_error("object can't be its own ancestor!");
 	}
+
+	if(WorldObject::parent != nullptr){
+		std::vector<WorldObject*>& siblings = WorldObject::parent->children;
+		siblings.erase(std::remove(siblings.begin(), siblings.end(), this), siblings.end());
+	}
+
+	WorldObject::parent = parent;
+
+	if(parent != nullptr){
+		parent->children.push_back(this);
+	}
+
+	markDirty();
+}
+
+WorldObject* WorldObject::getParent() const{
+	return parent;
+}
+
+const std::vector<WorldObject*>& WorldObject::getChildren() const{
+	return children;
+}
+
+uint32_t WorldObject::getTransformSlot() const{
+	return transformSlot;
+}
+
+bool WorldObject::isDirty() const{
+	return dirty;
+}
+
+void WorldObject::cleanup(){
+	// Modifiers are owned by the Storage pools
+	modifiers.clear();
 }
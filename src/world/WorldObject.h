@@ -7,6 +7,7 @@
 #include "../interfaces/IObjectModifier.h"
 #include "../physics/CollisionComponent.h"
 #include "../physics/IPhysicsComponent.h"
+#include "../storage/ComponentRegistry.h"
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/quaternion.hpp>
@@ -22,7 +23,8 @@ public:
 	WorldObject(const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale);
 
 	void addModifier(IObjectModifier* modifier);
-	void setTransformation();
+	const std::vector<IObjectModifier*>& getModifiers() const;
+	void updateTransformation();
 	virtual void update(double time);
 	void cleanup();
 
@@ -30,15 +32,43 @@ public:
 	void setCollision(CollisionComponent *collisionComponent);
 	void setPhysics(IPhysicsComponent *physicsComponent);
 
+	const glm::vec3& getPosition() const;
+	const glm::quat& getRotation() const;
+	const glm::vec3& getScale() const;
+	void setPosition(const glm::vec3& position);
+	void setRotation(const glm::quat& rotation);
+	void setScale(const glm::vec3& scale);
+	void move(const glm::vec3& direction);
+
+	// Transformations of children are relative to their parent
+	void setParent(WorldObject* parent);
+	WorldObject* getParent() const;
+	const std::vector<WorldObject*>& getChildren() const;
+	uint32_t getTransformSlot() const;
+	bool isDirty() const;
+
 	RenderComponent* renderComponent = nullptr;
 	CollisionComponent* collisionComponent = nullptr;
 	IPhysicsComponent* physicsComponent = nullptr;
+
+	Handle handle;
+
+private:
+	std::vector<IObjectModifier*> modifiers;
+
 	glm::vec3 position;
 	glm::quat rotation;
 	glm::vec3 scale;
 
-private:
-	std::vector<IObjectModifier*> modifiers;
+	WorldObject* parent = nullptr;
+	std::vector<WorldObject*> children;
+
+	// Index of the object's matrices in Storage::transforms
+	uint32_t transformSlot;
+	bool dirty = false;
+
+	void markDirty();
+	void computeTransformation();
 };
 
 